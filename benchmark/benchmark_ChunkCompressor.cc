@@ -0,0 +1,135 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * benchmark_ChunkCompressor.cc
+ *
+ *  Throughput of writing a compressed extendible data set, as done by the HDF5DAQ in append mode. The data is either
+ *  compressed by the HDF5 library while writing (0 threads) or by the ChunkCompressor and written with
+ *  H5Dwrite_chunk.
+ *
+ *  Usage: benchmark_ChunkCompressor [maxThreads] [nChunks]
+ */
+
+#include "ChunkCompressor.h"
+
+#include <H5Cpp.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace ChimeraTK::detail;
+
+static constexpr hsize_t nElements = 2048;  // elements per row (one trigger)
+static constexpr hsize_t chunkRows = 8;     // rows per chunk -> 64 KiB chunks of float
+static constexpr int compressionLevel = 6;
+static const char* fileName = "benchmark_ChunkCompressor.h5";
+
+/**********************************************************************************************************************/
+
+/** Noisy sine, so the data compresses similar to real waveforms. */
+static std::vector<float> makeRow(hsize_t row) {
+  std::vector<float> data(nElements);
+  uint32_t seed = row * 2654435761u;
+  for(hsize_t i = 0; i < nElements; ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    data[i] = std::round(1000.f * std::sin(0.01f * (i + row))) + float(seed >> 28);
+  }
+  return data;
+}
+
+/**********************************************************************************************************************/
+
+static H5::DataSet createDataSet(H5::H5File& file) {
+  hsize_t dims[2] = {0, nElements};
+  hsize_t maxDims[2] = {H5S_UNLIMITED, nElements};
+  hsize_t chunkDims[2] = {chunkRows, nElements};
+  H5::DSetCreatPropList properties;
+  properties.setChunk(2, chunkDims);
+  properties.setShuffle();
+  properties.setDeflate(compressionLevel);
+  return file.createDataSet("data", H5::PredType::NATIVE_FLOAT, H5::DataSpace(2, dims, maxDims), properties);
+}
+
+/**********************************************************************************************************************/
+
+/** Write nChunks chunks, returns the throughput of uncompressed data in MB/s. */
+static double run(size_t nThreads, size_t nChunks, const std::vector<std::vector<float>>& rows) {
+  H5::H5File file(fileName, H5F_ACC_TRUNC);
+  auto dataSet = createDataSet(file);
+  size_t chunkBytes = chunkRows * nElements * sizeof(float);
+
+  auto start = std::chrono::steady_clock::now();
+  if(nThreads == 0) {
+    hsize_t memDims = chunkRows * nElements;
+    H5::DataSpace memSpace(1, &memDims);
+    std::vector<float> chunk(chunkRows * nElements);
+    for(size_t c = 0; c < nChunks; ++c) {
+      for(hsize_t r = 0; r < chunkRows; ++r) {
+        std::memcpy(&chunk[r * nElements], rows[(c * chunkRows + r) % rows.size()].data(), nElements * sizeof(float));
+      }
+      hsize_t dims[2] = {(c + 1) * chunkRows, nElements};
+      dataSet.extend(dims);
+      auto fileSpace = dataSet.getSpace();
+      hsize_t offset[2] = {c * chunkRows, 0};
+      hsize_t count[2] = {chunkRows, nElements};
+      fileSpace.selectHyperslab(H5S_SELECT_SET, count, offset);
+      dataSet.write(chunk.data(), H5::PredType::NATIVE_FLOAT, memSpace, fileSpace);
+    }
+  }
+  else {
+    ChunkCompressor compressor(nThreads);
+    std::deque<std::future<std::vector<char>>> pending;
+    hsize_t nWritten = 0;
+    auto writeFront = [&] {
+      auto data = pending.front().get();
+      pending.pop_front();
+      hsize_t dims[2] = {(nWritten + 1) * chunkRows, nElements};
+      dataSet.extend(dims);
+      hsize_t offset[2] = {nWritten * chunkRows, 0};
+      H5Dwrite_chunk(dataSet.getId(), H5P_DEFAULT, 0, offset, data.size(), data.data());
+      ++nWritten;
+    };
+    for(size_t c = 0; c < nChunks; ++c) {
+      std::vector<char> chunk(chunkBytes);
+      for(hsize_t r = 0; r < chunkRows; ++r) {
+        std::memcpy(&chunk[r * nElements * sizeof(float)], rows[(c * chunkRows + r) % rows.size()].data(),
+            nElements * sizeof(float));
+      }
+      pending.push_back(compressor.compress(std::move(chunk), sizeof(float), true, compressionLevel));
+      // limit the number of chunks in flight, as the DAQ is limited by the rate of incoming triggers
+      while(pending.size() > 4 * nThreads) writeFront();
+    }
+    while(!pending.empty()) writeFront();
+  }
+  file.close();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  return double(nChunks * chunkBytes) / 1e6 / elapsed.count();
+}
+
+/**********************************************************************************************************************/
+
+int main(int argc, char* argv[]) {
+  size_t maxThreads = argc > 1 ? std::stoul(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+  size_t nChunks = argc > 2 ? std::stoul(argv[2]) : 2000;
+
+  std::vector<std::vector<float>> rows;
+  for(hsize_t r = 0; r < 64; ++r) rows.push_back(makeRow(r));
+
+  std::cout << "Writing " << nChunks << " chunks of " << chunkRows * nElements * sizeof(float) / 1024
+            << " KiB (shuffle + deflate level " << compressionLevel << ")" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "MB/s" << std::endl;
+  for(size_t nThreads = 0; nThreads <= maxThreads; nThreads = nThreads == 0 ? 1 : 2 * nThreads) {
+    std::cout << std::setw(8) << nThreads << std::setw(12) << std::fixed << std::setprecision(1)
+              << run(nThreads, nChunks, rows) << std::endl;
+  }
+  std::remove(fileName);
+  return 0;
+}
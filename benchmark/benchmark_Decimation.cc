@@ -0,0 +1,111 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * benchmark_Decimation.cc
+ *
+ *  Throughput of the decimation kernels compared to the strided loop used by previous versions and to plain scalar
+ *  loops computing the same result, for typical trace lengths.
+ *
+ *  Usage: benchmark_Decimation [decimationFactor]
+ */
+
+#include "Decimation.h"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+using namespace ChimeraTK;
+using namespace ChimeraTK::detail;
+
+/**********************************************************************************************************************/
+
+/** Reference implementations: one value after the other */
+template<typename T>
+struct Scalar {
+  static void pick(const T* in, size_t n, size_t factor, T* out) {
+    for(size_t i = 0; i < n / factor; ++i) out[i] = in[i * factor];
+  }
+
+  static void mean(const T* in, size_t n, size_t factor, T* out) {
+    for(size_t j = 0; j < n / factor; ++j) {
+      typename DecimationKernels<T>::Accumulator sum = 0;
+      for(size_t k = 0; k < factor; ++k) sum += in[j * factor + k];
+      out[j] = static_cast<T>(sum / factor);
+    }
+  }
+
+  static void minMax(const T* in, size_t n, size_t factor, T* out) {
+    for(size_t j = 0; j < n / factor; ++j) {
+      T min = in[j * factor], max = in[j * factor];
+      for(size_t k = 1; k < factor; ++k) {
+        min = std::min(min, in[j * factor + k]);
+        max = std::max(max, in[j * factor + k]);
+      }
+      out[2 * j] = min;
+      out[2 * j + 1] = max;
+    }
+  }
+};
+
+/**********************************************************************************************************************/
+
+/** Processed input samples per second in units of 10^6 */
+static double measure(const std::function<void()>& decimate, size_t nElements) {
+  // repeat until at least 0.2 s have passed, so short traces are measured reliably
+  size_t nRepetitions = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{0};
+  while(elapsed.count() < 0.2) {
+    decimate();
+    ++nRepetitions;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  return double(nRepetitions * nElements) / 1e6 / elapsed.count();
+}
+
+/**********************************************************************************************************************/
+
+template<typename T>
+static void run(const std::string& typeName, size_t factor) {
+  for(size_t nElements : {1000, 10000, 100000, 1000000}) {
+    std::vector<T> input(nElements);
+    for(size_t i = 0; i < nElements; ++i) input[i] = static_cast<T>(1000 * std::sin(0.001 * i) + (i * 7919) % 13);
+    std::vector<T> output(2 * (nElements / factor));
+    auto* in = input.data();
+    auto* out = output.data();
+
+    auto kernel = [&](DecimationMode mode) {
+      return measure([&] { decimate(in, nElements, DecimationSettings{factor, mode}, out); }, nElements);
+    };
+    std::cout << std::setw(8) << typeName << std::setw(9) << nElements << std::fixed << std::setprecision(0)
+              << std::setw(10) << measure([&] { Scalar<T>::pick(in, nElements, factor, out); }, nElements)
+              << std::setw(10) << kernel(DecimationMode::pick)
+              << std::setw(10) << measure([&] { Scalar<T>::mean(in, nElements, factor, out); }, nElements)
+              << std::setw(10) << kernel(DecimationMode::mean)
+              << std::setw(10) << measure([&] { Scalar<T>::minMax(in, nElements, factor, out); }, nElements)
+              << std::setw(10) << kernel(DecimationMode::minMax) << std::setw(10) << kernel(DecimationMode::peak)
+              << std::endl;
+  }
+}
+
+/**********************************************************************************************************************/
+
+int main(int argc, char* argv[]) {
+  size_t factor = argc > 1 ? std::stoul(argv[1]) : 10;
+
+  std::cout << "Decimation factor " << factor << ", throughput in 10^6 input samples per second" << std::endl;
+  std::cout << std::setw(8) << "type" << std::setw(9) << "length" << std::setw(10) << "loop" << std::setw(10)
+            << "pick" << std::setw(10) << "mean(sc)" << std::setw(10) << "mean" << std::setw(10) << "mm(sc)"
+            << std::setw(10) << "minMax" << std::setw(10) << "peak" << std::endl;
+  run<int16_t>("int16", factor);
+  run<int32_t>("int32", factor);
+  run<float>("float", factor);
+  run<double>("double", factor);
+  return 0;
+}
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/*
+ * benchmark_Startup.cc
+ *
+ *  Startup time of a DAQ module recording all registers of a large device. The device is a dummy device with the
+ *  given number of scalar registers, generated in a temporary map file. The time needed to add the registers to the
+ *  DAQ and to start the application (until the initial values are written) is measured. The DAQ module reports the
+ *  durations of its startup phases in addition.
+ *
+ *  Usage: benchmark_Startup [nRegisters]
+ */
+
+#ifdef ENABLE_HDF5
+#  include "MicroDAQHDF5.h"
+#else
+#  include "MicroDAQROOT.h"
+#endif
+
+#include <ChimeraTK/ApplicationCore/ApplicationCore.h>
+#include <ChimeraTK/ApplicationCore/TestFacility.h>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#ifdef ENABLE_HDF5
+using DAQ = ChimeraTK::HDF5DAQ<int32_t>;
+#else
+using DAQ = ChimeraTK::RootDAQ<int32_t>;
+#endif
+
+/**********************************************************************************************************************/
+
+/** Provides the trigger of the device and the DAQ */
+struct TriggerModule : public ChimeraTK::ApplicationModule {
+  using ChimeraTK::ApplicationModule::ApplicationModule;
+
+  ChimeraTK::ScalarOutput<int32_t> tick{this, "tick", "", "Trigger of the device and the DAQ"};
+  ChimeraTK::ScalarPushInput<int32_t> step{this, "step", "", "Writes the trigger"};
+
+  void mainLoop() override {
+    writeAll();
+    while(true) {
+      step.read();
+      tick = (int32_t)step;
+      tick.write();
+    }
+  }
+};
+
+/**********************************************************************************************************************/
+
+struct StartupApp : public ChimeraTK::Application {
+  explicit StartupApp(const std::string& cdd) : Application("benchmarkStartup"), device(this, cdd, "/Trigger/tick") {
+    auto start = std::chrono::steady_clock::now();
+    daq.addSource("/Registers", "");
+    addSourceDuration = std::chrono::steady_clock::now() - start;
+  }
+  ~StartupApp() override { shutdown(); }
+
+  TriggerModule trigger{this, "Trigger", "Trigger module"};
+  ChimeraTK::DeviceModule device;
+  DAQ daq{this, "MicroDAQ", "DAQ of all registers", 10, 1000, {}, "/Trigger/tick"};
+
+  std::chrono::steady_clock::duration addSourceDuration{};
+};
+
+/**********************************************************************************************************************/
+
+/** Write a map file with nRegisters 32 bit registers in modules of 100 registers each */
+static void writeMapFile(const std::string& fileName, size_t nRegisters) {
+  std::ofstream map(fileName);
+  for(size_t i = 0; i < nRegisters; ++i) {
+    map << "Registers.M" << i / 100 << ".R" << i % 100 << " 1 " << 4 * i << " 4 0 32 0 1\n";
+  }
+}
+
+/**********************************************************************************************************************/
+
+int main(int argc, char* argv[]) {
+  size_t nRegisters = argc > 1 ? std::stoul(argv[1]) : 20000;
+
+  auto mapFile = (boost::filesystem::temp_directory_path() / "benchmark_Startup.map").string();
+  writeMapFile(mapFile, nRegisters);
+
+  auto ms = [](std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+  };
+
+  {
+    auto start = std::chrono::steady_clock::now();
+    StartupApp app("(dummy?map=" + mapFile + ")");
+    auto constructed = std::chrono::steady_clock::now();
+    ChimeraTK::TestFacility tf(app);
+    tf.runApplication();
+    auto started = std::chrono::steady_clock::now();
+
+    std::cout << nRegisters << " registers: constructing the application took " << ms(constructed - start)
+              << " ms (addSource " << ms(app.addSourceDuration) << " ms), starting the application "
+              << ms(started - constructed) << " ms." << std::endl;
+  }
+
+  boost::filesystem::remove(mapFile);
+  return 0;
+}
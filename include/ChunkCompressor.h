@@ -0,0 +1,114 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#pragma once
+
+#include <zlib.h>
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace ChimeraTK { namespace detail {
+
+  /********************************************************************************************************************/
+
+  /**
+   * Thread pool compressing chunks of HDF5 data sets with the shuffle (optional) and deflate filters. The result is
+   * identical to the output of the HDF5 filter pipeline, so it can be written to the file with H5Dwrite_chunk by the
+   * thread owning the file, which then does not spend any time on compression.
+   */
+  class ChunkCompressor {
+   public:
+    explicit ChunkCompressor(size_t nThreads) {
+      for(size_t i = 0; i < nThreads; ++i) _threads.emplace_back([this] { run(); });
+    }
+
+    /** Compresses all queued chunks before the threads are stopped. */
+    ~ChunkCompressor() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _wakeUp.notify_all();
+      for(auto& thread : _threads) thread.join();
+    }
+
+    /**
+     * Queue the chunk for compression. typeSize is the size of a single element in bytes, used by the shuffle filter.
+     */
+    std::future<std::vector<char>> compress(std::vector<char> chunk, size_t typeSize, bool shuffle, int level) {
+      std::packaged_task<std::vector<char>()> job([chunk = std::move(chunk), typeSize, shuffle, level] {
+        return compressChunk(chunk, typeSize, shuffle, level);
+      });
+      auto result = job.get_future();
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+      }
+      _wakeUp.notify_one();
+      return result;
+    }
+
+    /** Number of worker threads */
+    size_t getNThreads() const { return _threads.size(); }
+
+    /**
+     * Apply the filters to the chunk in the calling thread. Throws std::runtime_error if zlib fails.
+     */
+    static std::vector<char> compressChunk(const std::vector<char>& chunk, size_t typeSize, bool shuffle, int level) {
+      const std::vector<char>* input = &chunk;
+
+      // shuffle filter: store the n-th byte of all elements together, trailing bytes are kept
+      std::vector<char> shuffled;
+      if(shuffle && typeSize > 1) {
+        shuffled.resize(chunk.size());
+        size_t nElements = chunk.size() / typeSize;
+        for(size_t byte = 0; byte < typeSize; ++byte) {
+          for(size_t i = 0; i < nElements; ++i) {
+            shuffled[byte * nElements + i] = chunk[i * typeSize + byte];
+          }
+        }
+        std::copy(chunk.begin() + nElements * typeSize, chunk.end(), shuffled.begin() + nElements * typeSize);
+        input = &shuffled;
+      }
+
+      // deflate filter: zlib stream as produced by compress2()
+      auto compressedSize = compressBound(input->size());
+      std::vector<char> compressed(compressedSize);
+      if(compress2(reinterpret_cast<Bytef*>(compressed.data()), &compressedSize,
+             reinterpret_cast<const Bytef*>(input->data()), input->size(), level) != Z_OK) {
+        throw std::runtime_error("ChunkCompressor: Compressing chunk failed.");
+      }
+      compressed.resize(compressedSize);
+      return compressed;
+    }
+
+   private:
+    void run() {
+      while(true) {
+        std::packaged_task<std::vector<char>()> job;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _wakeUp.wait(lock, [this] { return _stop || !_jobs.empty(); });
+          if(_jobs.empty()) return;
+          job = std::move(_jobs.front());
+          _jobs.pop_front();
+        }
+        job();
+      }
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    std::deque<std::packaged_task<std::vector<char>()>> _jobs;
+    bool _stop{false};
+    std::vector<std::thread> _threads; ///< must be last, so all other members are initialised when the threads start
+  };
+
+  /********************************************************************************************************************/
+
+}} // namespace ChimeraTK::detail
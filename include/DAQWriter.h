@@ -0,0 +1,276 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#pragma once
+
+#include <ChimeraTK/SupportedUserTypes.h>
+#include <ChimeraTK/VersionNumber.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ChimeraTK { namespace detail {
+
+  /********************************************************************************************************************/
+
+  /**
+   * Values of all DAQ variables and the internal data of a single trigger. The buffers are stored in the same order as
+   * the accessors in BaseDAQ::_accessorListMap.
+   */
+  template<typename TRIGGERTYPE>
+  struct DAQSnapshot {
+    template<typename UserType>
+    using BufferList = std::vector<std::vector<UserType>>;
+    TemplateUserTypeMapNoVoid<BufferList> buffers;
+
+    /** Version numbers of the values in the buffers, used to detect which variables were updated */
+    template<typename UserType>
+    using VersionList = std::vector<VersionNumber>;
+    TemplateUserTypeMapNoVoid<VersionList> versions;
+
+    VersionNumber version{nullptr};
+    uint64_t triggerNumber{0};
+    TRIGGERTYPE nMissedTriggers{};
+    int64_t triggerPeriod{0};
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Settings of a DAQ implementation for a single file. They are read from the control variables by the DAQ thread
+   * when a new file is requested, so the storage never accesses control variables itself.
+   */
+  struct FileSettings {
+    virtual ~FileSettings() = default;
+
+    /**
+     * Variables recorded in the file, in the same order as the buffers of the snapshot. Filled by the BaseDAQ from
+     * includeVariables and excludeVariables. All variables are recorded if the list of a UserType is empty.
+     */
+    template<typename UserType>
+    using RecordedList = std::vector<bool>;
+    TemplateUserTypeMapNoVoid<RecordedList> recorded;
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Set the flag recorded of all columns of the write plan from the file settings. The write plan is a
+   * TemplateUserTypeMapNoVoid of vectors of columns in the same order as the buffers of the snapshot. Returns true if
+   * any flag was changed.
+   */
+  template<typename COLUMNLISTMAP>
+  bool applyRecordedMask(COLUMNLISTMAP& columnListMap, const FileSettings& settings) {
+    bool changed = false;
+    boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+      using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+      auto& mask = boost::fusion::at_key<UserType>(settings.recorded.table);
+      auto& columnList = pair.second;
+      for(size_t i = 0; i < columnList.size(); ++i) {
+        bool recorded = mask.empty() || mask[i];
+        changed = changed || columnList[i].recorded != recorded;
+        columnList[i].recorded = recorded;
+      }
+    });
+    return changed;
+  }
+
+  /********************************************************************************************************************/
+
+  /**
+   * Interface of the file storage of a DAQ implementation. In case asynchronous writing is enabled, open(), write()
+   * and close() are called by the writer thread, all other functions are always called by the DAQ thread.
+   */
+  template<typename TRIGGERTYPE>
+  struct DAQStorage {
+    virtual ~DAQStorage() = default;
+
+    /** Read the control variables relevant for the next file. */
+    virtual std::shared_ptr<FileSettings> getFileSettings() { return nullptr; }
+
+    /** Open the given file. Returns false if the file could not be opened. */
+    virtual bool open(const std::string& fileName, const FileSettings* settings) = 0;
+
+    /** Write the snapshot to the current file. Returns false in case of an error, the file is closed then. */
+    virtual bool write(const DAQSnapshot<TRIGGERTYPE>& snapshot) = 0;
+
+    /** Close the current file. Does nothing if no file is opened. */
+    virtual void close() = 0;
+
+    /** Publish the storage specific status variables. Called once per trigger. */
+    virtual void updateStatus() {}
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Entry of the writer queue. The commands are executed in the order open, write, close.
+   */
+  template<typename TRIGGERTYPE>
+  struct DAQCommand {
+    std::string fileName;                         ///< File to be opened (closing the current file), empty if none
+    std::shared_ptr<const FileSettings> settings; ///< Settings for the file to be opened
+    bool write{false};                            ///< Write the snapshot to the current file
+    bool close{false};                            ///< Close the current file after writing
+    DAQSnapshot<TRIGGERTYPE> snapshot;
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Bounded lock-free ring for a single producer and a single consumer. All elements are allocated on construction
+   * and reused, so elements are filled and read in place.
+   */
+  template<typename T>
+  class SPSCRing {
+   public:
+    SPSCRing(size_t capacity, const T& prototype) : _slots(capacity + 1, prototype) {}
+
+    /** Producer: element to be filled next, nullptr if the ring is full. */
+    T* claim() {
+      auto head = _head.load(std::memory_order_relaxed);
+      if(next(head) == _tail.load(std::memory_order_acquire)) return nullptr;
+      return &_slots[head];
+    }
+
+    /** Producer: hand the claimed element over to the consumer. */
+    void publish() { _head.store(next(_head.load(std::memory_order_relaxed)), std::memory_order_release); }
+
+    /** Consumer: element to be processed next, nullptr if the ring is empty. */
+    T* peek() {
+      auto tail = _tail.load(std::memory_order_relaxed);
+      if(tail == _head.load(std::memory_order_acquire)) return nullptr;
+      return &_slots[tail];
+    }
+
+    /** Consumer: return the processed element to the producer. */
+    void release() { _tail.store(next(_tail.load(std::memory_order_relaxed)), std::memory_order_release); }
+
+    /** Number of published elements not yet released. */
+    size_t size() const {
+      auto head = _head.load(std::memory_order_acquire);
+      auto tail = _tail.load(std::memory_order_acquire);
+      return head >= tail ? head - tail : head + _slots.size() - tail;
+    }
+
+   private:
+    size_t next(size_t index) const { return index + 1 == _slots.size() ? 0 : index + 1; }
+
+    std::vector<T> _slots;
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Writer thread executing the DAQ commands queued by the DAQ thread on the storage. Errors are reported via
+   * openFailed and writeFailed, which are reset by the DAQ thread.
+   */
+  template<typename TRIGGERTYPE>
+  class DAQWriter {
+   public:
+    DAQWriter(DAQStorage<TRIGGERTYPE>& storage, size_t queueLength, const DAQSnapshot<TRIGGERTYPE>& prototype)
+    : _storage(storage), _queue(queueLength, DAQCommand<TRIGGERTYPE>{{}, {}, false, false, prototype}),
+      _thread([this] { run(); }) {}
+
+    /** Executes all remaining commands before the thread is stopped. */
+    ~DAQWriter() {
+      _stop = true;
+      _wakeUp.notify_one();
+      _thread.join();
+    }
+
+    /**
+     * Reset and return the next free queue entry. If the queue is full, nullptr is returned or, if wait is true, the
+     * function blocks until an entry is free.
+     */
+    DAQCommand<TRIGGERTYPE>* claim(bool wait) {
+      auto* command = _queue.claim();
+      while(!command && wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        command = _queue.claim();
+      }
+      if(command) {
+        command->fileName.clear();
+        command->settings.reset();
+        command->write = false;
+        command->close = false;
+      }
+      return command;
+    }
+
+    /** Pass the claimed entry to the writer thread. */
+    void submit() {
+      _queue.publish();
+      _highWaterMark = std::max(_highWaterMark, _queue.size());
+      _wakeUp.notify_one();
+    }
+
+    /** Number of queued commands not yet executed. */
+    size_t depth() const { return _queue.size(); }
+
+    /** Maximum depth of the queue since the writer was started. */
+    size_t highWaterMark() const { return _highWaterMark; }
+
+    std::atomic<bool> openFailed{false};
+    std::atomic<bool> writeFailed{false};
+
+    /** Number of open commands executed. All files except the one opened last are closed. */
+    std::atomic<uint64_t> nOpenedFiles{0};
+
+   private:
+    void run() {
+      while(true) {
+        auto* command = _queue.peek();
+        if(!command) {
+          if(_stop) break;
+          // The DAQ thread notifies without holding the mutex to keep submit() lock-free, hence a missed notification
+          // is possible and only delays writing by the timeout.
+          std::unique_lock<std::mutex> lock(_mutex);
+          _wakeUp.wait_for(lock, std::chrono::milliseconds(10));
+          continue;
+        }
+        execute(*command);
+        _queue.release();
+      }
+      _storage.close();
+    }
+
+    void execute(DAQCommand<TRIGGERTYPE>& command) {
+      if(!command.fileName.empty()) {
+        _storage.close();
+        _isOpened = _storage.open(command.fileName, command.settings.get());
+        if(!_isOpened) openFailed = true;
+        ++nOpenedFiles;
+      }
+      if(command.write && _isOpened) {
+        _isOpened = _storage.write(command.snapshot);
+        if(!_isOpened) writeFailed = true;
+      }
+      if(command.close && _isOpened) {
+        _storage.close();
+        _isOpened = false;
+      }
+    }
+
+    DAQStorage<TRIGGERTYPE>& _storage;
+    SPSCRing<DAQCommand<TRIGGERTYPE>> _queue;
+    size_t _highWaterMark{0}; ///< only accessed by the DAQ thread
+    bool _isOpened{false};    ///< only accessed by the writer thread
+    std::atomic<bool> _stop{false};
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    std::thread _thread; ///< must be last, so all other members are initialised when the thread starts
+  };
+
+  /********************************************************************************************************************/
+
+}} // namespace ChimeraTK::detail
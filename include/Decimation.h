@@ -0,0 +1,259 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ChimeraTK {
+
+  /********************************************************************************************************************/
+
+  /**
+   * Method used to reduce arrays above the decimation threshold. Each output value (or pair of values for minMax) is
+   * computed from a bin of decimationFactor consecutive input values, incomplete bins at the end are dropped.
+   */
+  enum class DecimationMode {
+    pick,   ///< First value of each bin (default, as done by previous versions)
+    mean,   ///< Mean of each bin, truncated towards zero for integer types
+    minMax, ///< Minimum and maximum of each bin, hence the output has twice the length of the other modes
+    peak    ///< Value with the largest magnitude of each bin, keeping its sign
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Decimation of all variables whose name in the DAQ (e.g. "/Dummy/out") matches the pattern. The pattern uses the
+   * shell wildcards of fnmatch(3), where '*' also matches '/'. Settings not given are taken from the DAQ module.
+   */
+  struct DecimationRule {
+    std::string pattern;
+
+    /** Decimation factor, applied regardless of the decimation threshold to variables with at least factor elements
+     * in the region of interest. If 0, the decimation factor of the DAQ module is applied to arrays above the
+     * decimation threshold. */
+    uint32_t factor{0};
+
+    /** Decimation mode, if not given the decimation mode of the DAQ module is used */
+    std::optional<DecimationMode> mode;
+
+    /** Region of interest: only roiLength elements starting at roiBegin are stored, 0 means up to the end. If roiBegin
+     * is beyond the end of the array, only the last element is stored. */
+    uint32_t roiBegin{0};
+    uint32_t roiLength{0};
+  };
+
+  namespace detail {
+
+    /******************************************************************************************************************/
+
+    /**
+     * Decimation parameters of a single variable.
+     */
+    struct DecimationSettings {
+      size_t factor{1};
+      DecimationMode mode{DecimationMode::pick};
+
+      /** Region of interest, applied before the decimation by the Decimator. roiLength 0 means up to the end. */
+      size_t roiBegin{0};
+      size_t roiLength{0};
+
+      /** Length of the region of interest for the given array length. */
+      size_t roiSize(size_t nElements) const {
+        size_t available = nElements - std::min(roiBegin, nElements);
+        return roiLength > 0 ? std::min(roiLength, available) : available;
+      }
+
+      /** Length of the decimated array for the given input length, the region of interest is not considered. */
+      size_t length(size_t nElements) const {
+        if(factor <= 1) return nElements;
+        return (mode == DecimationMode::minMax ? 2 : 1) * (nElements / factor);
+      }
+    };
+
+    /******************************************************************************************************************/
+
+    /**
+     * Decimation kernels. Bins are processed in blocks of kBlockSize neighbouring bins, which are reduced side by side,
+     * so the compiler can map the inner loops to SIMD instructions for any decimation factor. The order of operations
+     * within each bin is the same as in a plain loop, hence the results are identical. Only arithmetic types support
+     * the modes other than pick.
+     */
+    template<typename UserType>
+    struct DecimationKernels {
+      static constexpr size_t kBlockSize = 8;
+
+      /** Accumulator of the mean, wide enough for any realistic bin size */
+      using Accumulator = std::conditional_t<std::is_floating_point_v<UserType>, double,
+          std::conditional_t<std::is_signed_v<UserType>, int64_t, uint64_t>>;
+
+      static void pick(const UserType* input, size_t nBins, size_t factor, UserType* output) {
+        for(size_t j = 0; j < nBins; ++j) output[j] = input[j * factor];
+      }
+
+      static void mean(const UserType* input, size_t nBins, size_t factor, UserType* output) {
+        size_t j = 0;
+        for(; j + kBlockSize <= nBins; j += kBlockSize) {
+          meanOfBins<kBlockSize>(input + j * factor, factor, output + j);
+        }
+        for(; j < nBins; ++j) meanOfBins<1>(input + j * factor, factor, output + j);
+      }
+
+      static void minMax(const UserType* input, size_t nBins, size_t factor, UserType* output) {
+        size_t j = 0;
+        for(; j + kBlockSize <= nBins; j += kBlockSize) {
+          minMaxOfBins<kBlockSize>(input + j * factor, factor, output + 2 * j);
+        }
+        for(; j < nBins; ++j) minMaxOfBins<1>(input + j * factor, factor, output + 2 * j);
+      }
+
+      static void peak(const UserType* input, size_t nBins, size_t factor, UserType* output) {
+        UserType minMax[2 * kBlockSize];
+        for(size_t j = 0; j < nBins; j += kBlockSize) {
+          size_t nBlock = std::min(kBlockSize, nBins - j);
+          if(nBlock == kBlockSize) {
+            minMaxOfBins<kBlockSize>(input + j * factor, factor, minMax);
+          }
+          else {
+            for(size_t b = 0; b < nBlock; ++b) minMaxOfBins<1>(input + (j + b) * factor, factor, minMax + 2 * b);
+          }
+          for(size_t b = 0; b < nBlock; ++b) output[j + b] = largerMagnitude(minMax[2 * b], minMax[2 * b + 1]);
+        }
+      }
+
+     private:
+      template<size_t N>
+      static void meanOfBins(const UserType* input, size_t factor, UserType* output) {
+        Accumulator sum[N] = {};
+        for(size_t k = 0; k < factor; ++k) {
+          for(size_t b = 0; b < N; ++b) sum[b] += input[b * factor + k];
+        }
+        for(size_t b = 0; b < N; ++b) output[b] = static_cast<UserType>(sum[b] / static_cast<Accumulator>(factor));
+      }
+
+      /** Output contains minimum and maximum of each bin */
+      template<size_t N>
+      static void minMaxOfBins(const UserType* input, size_t factor, UserType* output) {
+        UserType min[N], max[N];
+        for(size_t b = 0; b < N; ++b) min[b] = max[b] = input[b * factor];
+        for(size_t k = 1; k < factor; ++k) {
+          for(size_t b = 0; b < N; ++b) {
+            UserType value = input[b * factor + k];
+            min[b] = value < min[b] ? value : min[b];
+            max[b] = value > max[b] ? value : max[b];
+          }
+        }
+        for(size_t b = 0; b < N; ++b) {
+          output[2 * b] = min[b];
+          output[2 * b + 1] = max[b];
+        }
+      }
+
+      /** Value with the larger magnitude, keeping its sign */
+      static UserType largerMagnitude(UserType min, UserType max) {
+        if constexpr(std::is_unsigned_v<UserType>) {
+          return max;
+        }
+        else if constexpr(std::is_integral_v<UserType>) {
+          // -(min + 1) >= max is |min| > |max| without overflow for the most negative value
+          return (min < 0 && -(min + 1) >= max) ? min : max;
+        }
+        else {
+          return -min > max ? min : max;
+        }
+      }
+    };
+
+    /******************************************************************************************************************/
+
+    /**
+     * Decimate nElements values of the input into output, which must have space for settings.length(nElements)
+     * values. Types which are not arithmetic (std::string, ChimeraTK::Boolean) are always decimated using pick. The
+     * region of interest is not applied.
+     */
+    template<typename UserType>
+    void decimate(const UserType* input, size_t nElements, const DecimationSettings& settings, UserType* output) {
+      using Kernels = DecimationKernels<UserType>;
+      size_t nBins = nElements / settings.factor;
+      if(settings.factor <= 1) {
+        std::copy(input, input + nElements, output);
+        return;
+      }
+      if constexpr(std::is_arithmetic_v<UserType>) {
+        switch(settings.mode) {
+          case DecimationMode::mean:
+            Kernels::mean(input, nBins, settings.factor, output);
+            return;
+          case DecimationMode::minMax:
+            Kernels::minMax(input, nBins, settings.factor, output);
+            return;
+          case DecimationMode::peak:
+            Kernels::peak(input, nBins, settings.factor, output);
+            return;
+          case DecimationMode::pick:
+            break;
+        }
+      }
+      Kernels::pick(input, nBins, settings.factor, output);
+    }
+
+    /******************************************************************************************************************/
+
+    /**
+     * Values to be written after decimation: every stride-th value of the first nElements values of data.
+     */
+    template<typename UserType>
+    struct DecimatedData {
+      const UserType* data;
+      size_t nElements;
+      size_t stride;
+    };
+
+    /******************************************************************************************************************/
+
+    /**
+     * Decimation of a single variable including its region of interest, holding the buffer for the decimated values,
+     * so no memory is allocated per trigger.
+     */
+    template<typename UserType>
+    struct Decimator {
+      Decimator(const DecimationSettings& decimationSettings, size_t nElements)
+      : settings(decimationSettings), roiBegin(std::min(settings.roiBegin, nElements)),
+        roiSize(settings.roiSize(nElements)) {
+        if(!std::is_arithmetic_v<UserType>) settings.mode = DecimationMode::pick;
+        nDecimated = settings.length(roiSize);
+        if(!isPick()) buffer.resize(nDecimated);
+      }
+
+      DecimationSettings settings;
+
+      /** Region of interest within the input */
+      size_t roiBegin, roiSize;
+
+      /** Length of the decimated array */
+      size_t nDecimated;
+
+      /** True if the decimated values are every factor-th input value, so the input can be used with a stride */
+      bool isPick() const { return settings.factor <= 1 || settings.mode == DecimationMode::pick; }
+
+      /**
+       * Decimate the input unless isPick() is true, in which case the input is returned with the decimation factor
+       * as stride.
+       */
+      DecimatedData<UserType> operator()(const std::vector<UserType>& input) {
+        if(isPick()) return {input.data() + roiBegin, roiSize, settings.factor};
+        decimate(input.data() + roiBegin, roiSize, settings, buffer.data());
+        return {buffer.data(), nDecimated, 1};
+      }
+
+      std::vector<UserType> buffer;
+    };
+
+    /******************************************************************************************************************/
+
+  } // namespace detail
+} // namespace ChimeraTK
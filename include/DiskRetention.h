@@ -0,0 +1,206 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ChimeraTK { namespace detail {
+
+  /********************************************************************************************************************/
+
+  /**
+   * Limits of the disk usage of the DAQ directory. A limit of 0 is not used.
+   */
+  struct RetentionSettings {
+    uint64_t maxDiskUsage{0}; ///< Maximum size of all ring buffer files in bytes
+    uint64_t minFreeSpace{0}; ///< Minimum space available on the file system in bytes
+
+    bool operator!=(const RetentionSettings& other) const {
+      return maxDiskUsage != other.maxDiskUsage || minFreeSpace != other.minFreeSpace;
+    }
+  };
+
+  /********************************************************************************************************************/
+
+  /**
+   * Thread with the lowest scheduling priority keeping the ring buffer files within the disk usage limits, by removing
+   * the oldest files. It also measures the disk usage and the rate at which the files grow. The files are handed over
+   * by the DAQ thread with each rollover, the usage is in addition measured periodically.
+   */
+  class DiskRetention {
+   public:
+    DiskRetention() : _thread([this] { run(); }) {}
+
+    ~DiskRetention() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _wakeUp.notify_one();
+      _thread.join();
+    }
+
+    /**
+     * Pass the file names of the ring buffer in the given directory, oldest first, and the limits. The nKeep newest
+     * files may still be written and are never removed. Called by the DAQ thread.
+     */
+    void update(const boost::filesystem::path& directory, std::vector<std::string> files,
+        const RetentionSettings& settings, size_t nKeep) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _directory = directory;
+        _files = std::move(files);
+        _settings = settings;
+        _nKeep = nKeep;
+        _requested = true;
+      }
+      _wakeUp.notify_one();
+    }
+
+    /**
+     * File names removed since the last call, so the DAQ thread can drop them from the ring buffer index.
+     */
+    std::vector<std::string> takeRemovedFiles() {
+      std::vector<std::string> removed;
+      std::lock_guard<std::mutex> lock(_mutex);
+      removed.swap(_removed);
+      return removed;
+    }
+
+    /** Size of all ring buffer files in bytes, measured last */
+    std::atomic<uint64_t> usedBytes{0};
+
+    /** Projected time in seconds until a limit is reached (or the file system is full without limits), -1 if the
+     * files do not grow */
+    std::atomic<int64_t> timeToFull{-1};
+
+   private:
+    void run() {
+      // only use otherwise idle CPU time, the thread is only relevant when the DAQ thread is not
+      setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      while(!_stop) {
+        _wakeUp.wait_for(lock, _scanPeriod, [&] { return _stop || _requested; });
+        if(_stop) break;
+        _requested = false;
+        if(_directory.empty()) continue;
+
+        auto directory = _directory;
+        auto files = _files;
+        auto settings = _settings;
+        auto nKeep = _nKeep;
+        lock.unlock();
+        auto removed = scan(directory, files, settings, nKeep);
+        lock.lock();
+
+        // the removed files must not be scanned again, unless the DAQ thread has handed over new files meanwhile
+        for(auto& name : removed) {
+          _files.erase(std::remove(_files.begin(), _files.end(), name), _files.end());
+        }
+        _removed.insert(_removed.end(), removed.begin(), removed.end());
+      }
+    }
+
+    /** Measure the disk usage and remove the oldest files exceeding the limits. Returns the removed files. */
+    std::vector<std::string> scan(const boost::filesystem::path& directory, const std::vector<std::string>& files,
+        const RetentionSettings& settings, size_t nKeep) {
+      boost::system::error_code ec;
+      std::vector<uint64_t> sizes(files.size(), 0);
+      uint64_t used = 0, growth = 0;
+      std::map<std::string, uint64_t> lastSizes;
+      for(size_t i = 0; i < files.size(); ++i) {
+        auto size = boost::filesystem::file_size(directory / files[i], ec);
+        if(ec) continue; // already removed as part of the ring buffer
+        sizes[i] = size;
+        used += size;
+        // the files only grow, new files are counted from 0
+        auto last = _lastSizes.find(files[i]);
+        growth += size - std::min<uint64_t>(size, last != _lastSizes.end() ? last->second : 0);
+        lastSizes[files[i]] = size;
+      }
+      _lastSizes = std::move(lastSizes);
+
+      auto space = boost::filesystem::space(directory, ec);
+      uint64_t available = ec ? std::numeric_limits<uint64_t>::max() : space.available;
+
+      // remove the oldest files, but never the files still written
+      std::vector<std::string> removed;
+      auto exceeded = [&] {
+        return (settings.maxDiskUsage > 0 && used > settings.maxDiskUsage) ||
+            (settings.minFreeSpace > 0 && available < settings.minFreeSpace);
+      };
+      for(size_t i = 0; i + nKeep < files.size() && exceeded(); ++i) {
+        if(sizes[i] == 0) continue;
+        boost::filesystem::remove(directory / files[i], ec);
+        if(ec) {
+          std::cerr << "Removing file to keep the disk quota failed: " << files[i] << ": " << ec.message() << std::endl;
+          continue;
+        }
+        used -= sizes[i];
+        available += sizes[i];
+        _lastSizes.erase(files[i]);
+        removed.push_back(files[i]);
+      }
+      usedBytes = used;
+
+      // projected time until the first limit is reached, from the growth since the last scan
+      auto now = std::chrono::steady_clock::now();
+      double seconds = std::chrono::duration<double>(now - _lastScan).count();
+      _lastScan = now;
+      uint64_t headroom = available;
+      if(settings.maxDiskUsage > 0) {
+        headroom = std::min(headroom, settings.maxDiskUsage - std::min(used, settings.maxDiskUsage));
+      }
+      if(settings.minFreeSpace > 0) {
+        headroom = std::min(headroom, available - std::min(available, settings.minFreeSpace));
+      }
+      if(growth == 0 || seconds <= 0) {
+        timeToFull = -1;
+      }
+      else {
+        timeToFull = static_cast<int64_t>(static_cast<double>(headroom) / (static_cast<double>(growth) / seconds));
+      }
+      return removed;
+    }
+
+    /** Period of the measurement if no files are handed over */
+    static constexpr std::chrono::seconds _scanPeriod{1};
+
+    // shared with the DAQ thread, protected by _mutex
+    boost::filesystem::path _directory;
+    std::vector<std::string> _files;
+    RetentionSettings _settings;
+    size_t _nKeep{1};
+    std::vector<std::string> _removed;
+    bool _requested{false};
+    bool _stop{false};
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+
+    // only accessed by the retention thread
+    std::map<std::string, uint64_t> _lastSizes;
+    std::chrono::steady_clock::time_point _lastScan{std::chrono::steady_clock::now()};
+
+    std::thread _thread; ///< must be last, so all other members are initialised when the thread starts
+  };
+
+  /********************************************************************************************************************/
+
+}} // namespace ChimeraTK::detail
@@ -12,5 +12,4 @@
 
 #  pragma link C++ namespace ChimeraTK;
 #  pragma link C++ namespace ChimeraTK::detail;
-#  pragma link C++ struct ChimeraTK::detail::TArrayStr;
 #endif
@@ -8,6 +8,10 @@
  *      Author: Klaus Zenker (HZDR)
  */
 
+#include "DAQWriter.h"
+#include "Decimation.h"
+#include "DiskRetention.h"
+
 #include <ChimeraTK/ApplicationCore/ApplicationModule.h>
 #include <ChimeraTK/ApplicationCore/ArrayAccessor.h>
 #include <ChimeraTK/ApplicationCore/ConfigReader.h>
@@ -19,8 +23,13 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <future>
 #include <map>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace ChimeraTK {
 
@@ -29,6 +38,24 @@ namespace ChimeraTK {
 
   /********************************************************************************************************************/
 
+  /**
+   * Group of variables recorded only on every nth trigger instead of on each trigger. A variable belongs to the group
+   * if its name in the DAQ (e.g. "/Dummy/out") matches the pattern, using the shell wildcards of fnmatch(3) where '*'
+   * also matches '/', or if the variable has the tag. An empty pattern or tag is not used.
+   */
+  struct RateGroup {
+    /** Name of the group, used for the separate data sets (HDF5), tree (ROOT) or RNTuple of the group */
+    std::string name;
+
+    /** The variables are recorded on each trigger whose trigger number is a multiple of everyNthTrigger */
+    uint32_t everyNthTrigger{1};
+
+    std::string pattern;
+    std::string tag;
+  };
+
+  /********************************************************************************************************************/
+
   /**
    *  Envelope class providing an easy-to-use high-level application interface. Instantiate this class in your
    *  application to use the MicroDAQ. It will configure itself using the ConfigReader (needs to be instantiated
@@ -44,13 +71,18 @@ namespace ChimeraTK {
      *
      *  In the config file, the following variables are required:
      *  - Configuration/MicroDAQ/enable (int32): boolean flag whether the MicroDAQ system is enabled or not
-     *  - Configuration/MicroDAQ/outputFormat (string): format of the output data, either "hdf5" or "root"
+     *  - Configuration/MicroDAQ/outputFormat (string): format of the output data, either "hdf5", "root" (TTree) or
+     *    "rntuple"
      *  - Configuration/MicroDAQ/decimationFactor (uint32): decimation factor applied to large arrays (above
      *    decimationThreshold)
      *  - Configuration/MicroDAQ/decimationThreshold (uint32): array size threshold above which the decimationFactor is
      *    applied
      *
      *  If Configuration/MicroDAQ/enable == 0, all other variables can be omitted.
+     *
+     *  Optional variables:
+     *  - Configuration/MicroDAQ/writerQueueLength (uint32): if not 0, files are written by a separate writer thread
+     *    with a queue of the given number of triggers, see BaseDAQ::setWriterQueueLength()
      */
     MicroDAQ(ModuleGroup* owner, const std::string& name, const std::string& description, const std::string& inputTag,
         const std::string& pathToTrigger, const std::unordered_set<std::string>& tags = {});
@@ -69,19 +101,29 @@ namespace ChimeraTK {
 
    protected:
     std::shared_ptr<BaseDAQ<TRIGGERTYPE>> impl;
+
+    /**
+     * Pass the optional decimation mode and decimation rules of the config file to the implementation.
+     */
+    void readDecimationConfig();
+
+    /**
+     * Pass the optional rate groups of the config file to the implementation.
+     */
+    void readRateGroupConfig();
   };
 
   /********************************************************************************************************************/
 
   /**
-   *  Base class used by the actual MicroDAQ implementations (HDF5, ROOT)
+   *  Base class used by the actual MicroDAQ implementations (HDF5, ROOT, RNTuple)
    */
   template<typename TRIGGERTYPE>
   class BaseDAQ : public ApplicationModule {
-   private:
+   protected:
     // Required by public member initialisers, hence define first
-    // Tag name to tag control variables published by the MicroDAQ module itself, to exclude them from being added to
-    // the DAQ as a source.
+    // Tag name to tag control variables published by the MicroDAQ module itself (including those of the derived DAQ
+    // implementations), to exclude them from being added to the DAQ as a source.
     const std::string _tagExcludeInternals{"_ChimeraTK_BaseDAQ_controlVars"};
 
    public:
@@ -107,8 +149,63 @@ namespace ChimeraTK {
     template<typename UserType>
     bool isAccessorUsingDAQTrigger(const ArrayPushInput<UserType>& accessor);
 
+    /**
+     * Write files asynchronously in a separate writer thread. The values of each trigger are copied into a queue of
+     * the given length, from which the writer thread takes them. If the queue is full, the values of the trigger are
+     * dropped (see status/nDroppedTriggers), while opening and closing files is never dropped.
+     *
+     * A length of 0 (default) disables the writer thread, so files are written directly by the DAQ module. This
+     * function must be called before the application is started.
+     */
+    void setWriterQueueLength(size_t queueLength) { _writerQueueLength = queueLength; }
+
+    /**
+     * Set the decimation mode of all arrays above the decimation threshold, for which no mode is set by a decimation
+     * rule. The default is DecimationMode::pick. The decimation is determined when a variable is added, hence this
+     * function must be called before the variables are added (addSource(), MicroDAQ::addDeviceModule()).
+     */
+    void setDecimationMode(DecimationMode mode) { _decimationMode = mode; }
+
+    /**
+     * Set the decimation mode of a single variable, given by its name in the DAQ (e.g. "/Dummy/out"). Only applies
+     * if the variable is above the decimation threshold. Same as adding a DecimationRule with the variable name as
+     * pattern and only the mode set.
+     */
+    void setDecimationMode(const std::string& variableName, DecimationMode mode) {
+      addDecimationRule({variableName, 0, mode});
+    }
+
+    /**
+     * Set decimation factor, mode and region of interest of all variables matching the pattern of the rule. If
+     * multiple rules match a variable, the rule added last is used. The decimation is determined when a variable is
+     * added, hence rules must be added before the variables (addSource(), MicroDAQ::addDeviceModule()).
+     */
+    void addDecimationRule(const DecimationRule& rule) { _decimationRules.push_back(rule); }
+
+    /**
+     * Record the variables of the rate group only on every nth trigger, counting the initial values as trigger 0. The
+     * variables of each group are stored separately from the variables recorded on each trigger, together with the
+     * trigger number and time stamp of the triggers recorded. If a variable belongs to several groups, the group added
+     * last is used. The group is determined when a variable is added, hence groups must be added before the variables
+     * (addSource(), MicroDAQ::addDeviceModule()).
+     */
+    void addRateGroup(const RateGroup& group);
+
+    /**
+     * Write files only around events instead of continuously. The values of the last nPreTrigger triggers are kept
+     * in memory. When the variable given by eventPath is written with a non-zero value, a new file is opened,
+     * containing the kept values, the values of the next trigger (the event trigger) and of the nPostTrigger following
+     * triggers. An event during the post-trigger phase extends the capture. nTriggersPerFile is not used.
+     *
+     * This function must be called before the application is started.
+     */
+    void enableEventCapture(const std::string& eventPath, size_t nPreTrigger, size_t nPostTrigger);
+
     ScalarPushInput<TRIGGERTYPE> trigger;
 
+    /** Event starting the capture, only present if enableEventCapture() was called */
+    ScalarPushInput<ChimeraTK::Boolean> captureEvent;
+
     ScalarPollInput<std::string> setPath{this, "directory",
         "", "Directory where to store the DAQ data. If not set a subdirectory called uDAQ in the current directory is used.",
         {_tagExcludeInternals}};
@@ -120,8 +217,38 @@ namespace ChimeraTK {
         "(oldest file will be overwritten).",
         {_tagExcludeInternals}};
 
-    ScalarPollInput<uint32_t> nTriggersPerFile{
-        this, "nTriggersPerFile", "", "Number of triggers stored in each file.", {_tagExcludeInternals}};
+    ScalarPollInput<uint32_t> nTriggersPerFile{this, "nTriggersPerFile", "",
+        "Number of triggers stored in each file. Not used if 0.", {_tagExcludeInternals}};
+
+    ScalarPollInput<uint64_t> maxFileSize{this, "maxFileSize", "bytes",
+        "Target size of each file. The file is closed once the estimated uncompressed size of the triggers written "
+        "reaches this size (see status/estimatedBytesPerTrigger). Not used if 0.",
+        {_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> maxFileDuration{this, "maxFileDuration", "s",
+        "Maximum time span of the triggers stored in each file. The file is closed with the first trigger at least "
+        "this time after the first trigger of the file. Not used if 0.",
+        {_tagExcludeInternals}};
+
+    ScalarPollInput<uint64_t> maxDiskUsage{this, "maxDiskUsage", "bytes",
+        "Maximum size of all files of the ring buffer. The oldest files are removed in the background to keep the "
+        "size. Not used if 0.",
+        {_tagExcludeInternals}};
+
+    ScalarPollInput<uint64_t> minFreeSpace{this, "minFreeSpace", "bytes",
+        "Minimum space available on the file system of the DAQ directory. The oldest files of the ring buffer are "
+        "removed in the background to keep the space available. Not used if 0.",
+        {_tagExcludeInternals}};
+
+    ScalarPollInput<std::string> includeVariables{this, "includeVariables", "",
+        "Space-separated glob patterns of the DAQ variables to record, e.g. '/Dummy/*'. All variables are recorded if "
+        "empty. Changes are applied when the next file is opened.",
+        {_tagExcludeInternals}};
+
+    ScalarPollInput<std::string> excludeVariables{this, "excludeVariables", "",
+        "Space-separated glob patterns of the DAQ variables not to record, taking precedence over includeVariables. "
+        "Changes are applied when the next file is opened.",
+        {_tagExcludeInternals}};
 
     struct Status : public VariableGroup {
       Status(const std::string& excludeTag, VariableGroup* owner, const std::string& name,
@@ -135,7 +262,25 @@ namespace ChimeraTK {
         currentEntry{
             this, "currentEntry", "", "Last entry number written. Is reset with every new file.", {excludeTag}},
         errorStatus{this, "DAQError", "", "True in case an error occurred. Reset by toggling enable.", {excludeTag}},
-        triggerPeriod{this, "triggerPeriod", "ms", "Number of skipped triggers between the last DAQ update."} {}
+        triggerPeriod{this, "triggerPeriod", "ms", "Number of skipped triggers between the last DAQ update."},
+        writerQueueDepth{this, "writerQueueDepth", "",
+            "Number of triggers queued but not yet written by the writer thread.", {excludeTag}},
+        writerQueueHighWaterMark{this, "writerQueueHighWaterMark", "",
+            "Maximum number of triggers queued for the writer thread since the start.", {excludeTag}},
+        nDroppedTriggers{this, "nDroppedTriggers", "",
+            "Number of triggers not written since the queue of the writer thread was full.", {excludeTag}},
+        nCapturedEvents{this, "nCapturedEvents", "", "Number of events written to files (event capture only).",
+            {excludeTag}},
+        estimatedBytesPerTrigger{this, "estimatedBytesPerTrigger", "bytes",
+            "Estimated uncompressed size of the data of a single trigger, used for maxFileSize.", {excludeTag}},
+        usedBytes{this, "usedBytes", "bytes", "Size of all files of the ring buffer.", {excludeTag}},
+        timeToFull{this, "timeToFull", "s",
+            "Projected time until maxDiskUsage or minFreeSpace (or the file system capacity if not set) is reached at "
+            "the current data rate. -1 if no data is written.",
+            {excludeTag}},
+        nRecordedVariables{this, "nRecordedVariables", "",
+            "Number of variables recorded in the current file, see includeVariables and excludeVariables.",
+            {excludeTag}} {}
       ScalarOutput<std::string> currentPath;
 
       ScalarOutput<uint32_t> currentBuffer;
@@ -147,6 +292,19 @@ namespace ChimeraTK {
       ScalarOutput<TRIGGERTYPE> nMissedTriggers;
       ScalarOutput<int64_t> triggerPeriod;
 
+      ScalarOutput<uint32_t> writerQueueDepth;
+      ScalarOutput<uint32_t> writerQueueHighWaterMark;
+      ScalarOutput<uint64_t> nDroppedTriggers;
+
+      ScalarOutput<uint32_t> nCapturedEvents;
+
+      ScalarOutput<uint64_t> estimatedBytesPerTrigger;
+
+      ScalarOutput<uint64_t> usedBytes;
+      ScalarOutput<int64_t> timeToFull;
+
+      ScalarOutput<uint32_t> nRecordedVariables;
+
     } status{_tagExcludeInternals, this, "status", "Status of the MicroDAQ.", {}};
     /**
      * Add all PVs found below the given directory.
@@ -170,6 +328,31 @@ namespace ChimeraTK {
     /** Parameters for the data decimation */
     uint32_t _decimationFactor, _decimationThreshold;
 
+    /** Decimation mode of all variables for which no mode is given by a decimation rule */
+    DecimationMode _decimationMode{DecimationMode::pick};
+
+    /** Decimation rules in the order they were added */
+    std::vector<DecimationRule> _decimationRules;
+
+    /**
+     * Decimation of the given variable with nElements elements, determined from the decimation rules.
+     */
+    detail::DecimationSettings resolveDecimation(const std::string& name, size_t nElements) const;
+
+    /** Rate groups in the order they were added. Group i of a variable refers to _rateGroups[i - 1]. */
+    std::vector<RateGroup> _rateGroups;
+
+    /**
+     * Rate group of the given variable, determined from the rate groups. Returns 0 if the variable is recorded on each
+     * trigger.
+     */
+    size_t resolveRateGroup(const std::string& name, const std::unordered_set<std::string>& tags) const;
+
+    /** Whether the variables of the given rate group are recorded with the trigger of the given number */
+    bool isRateGroupDue(size_t rateGroup, uint64_t triggerNumber) const {
+      return rateGroup == 0 || triggerNumber % _rateGroups[rateGroup - 1].everyNthTrigger == 0;
+    }
+
     boost::filesystem::path _daqPath; ///< DAQ path
 
     std::string _daqDefaultPath; ///< Default DAQ path stored to check easily for new DAQ path
@@ -178,8 +361,25 @@ namespace ChimeraTK {
 
     std::string _prefix; ///< Current prefix path+date
 
+    size_t _writerQueueLength{0}; ///< Length of the writer queue, 0 if writing synchronously
+
     /** Overall variable name list, used to detect name collisions */
-    std::set<std::string> _overallVariableList;
+    std::unordered_set<std::string> _overallVariableList;
+
+    /** Fully qualified path of the DAQ trigger, resolved by the first call of isAccessorUsingDAQTrigger() */
+    std::string _daqTriggerPath;
+
+    /** Whether the trigger of a device module (by alias or CDD) is the DAQ trigger, resolved once per device module */
+    std::unordered_map<std::string, bool> _deviceUsesDAQTrigger;
+
+    /** Durations of the startup phases, reported by runDAQ() once the initial values are written */
+    struct StartupTimes {
+      std::chrono::steady_clock::duration addVariables{}; ///< addSource() and MicroDAQ::addDeviceModule()
+      std::chrono::steady_clock::duration writePlan{};    ///< Write plan compiled by the DAQ implementation
+    } _startupTimes;
+
+    /** MicroDAQ::addDeviceModule() accounts the time needed to add the variables to the startup times */
+    friend class MicroDAQ<TRIGGERTYPE>;
 
     /**
      * boost::fusion::map of UserTypes to std::lists containing the names of the accessors. Technically there would be
@@ -198,6 +398,22 @@ namespace ChimeraTK {
     using AccessorList = std::list<ArrayPushInput<UserType>>;
     TemplateUserTypeMapNoVoid<AccessorList> _accessorListMap;
 
+    /**
+     * boost::fusion::map of UserTypes to std::lists containing the decimation of each variable, determined when the
+     * variable is added. Filled consistently with the accessorListMap.
+     */
+    template<typename UserType>
+    using DecimationList = std::list<detail::DecimationSettings>;
+    TemplateUserTypeMapNoVoid<DecimationList> _decimationListMap;
+
+    /**
+     * boost::fusion::map of UserTypes to std::lists containing the rate group of each variable (see
+     * resolveRateGroup()), determined when the variable is added. Filled consistently with the accessorListMap.
+     */
+    template<typename UserType>
+    using RateGroupList = std::list<size_t>;
+    TemplateUserTypeMapNoVoid<RateGroupList> _rateGroupListMap;
+
     /**
      * Set the daq path.
      *
@@ -224,16 +440,24 @@ namespace ChimeraTK {
     void updateDAQPath();
 
     /**
-     * Check if maximum number of entries per file is reached.
+     * Check if the file is complete, i.e. the number of entries, the estimated file size or the time span of the
+     * file given by nTriggersPerFile, maxFileSize and maxFileDuration is reached.
      *
      * In that case currentBuffer is increased and currentEntry is reset.
      *
-     * \return True if maximum entries are reached. Derived DAQ classed should
+     * \return True if the file is complete. Derived DAQ classed should
      * close the file.
      *
      */
     bool maxEntriesReached();
 
+    /**
+     * Estimate the uncompressed size of the data of a single trigger from the lengths of the accessors after
+     * decimation, including the internal data. Variables of rate groups are accounted with their average size per
+     * trigger.
+     */
+    uint64_t estimateBytesPerTrigger() const;
+
     /**
      * Reset error state, currentBuffer, currentEntry.
      */
@@ -241,20 +465,179 @@ namespace ChimeraTK {
 
     void updateDiagnostics();
 
+    /**
+     * Process the current trigger: open or close the file as requested by the control variables and write the values
+     * of all DAQ variables. Depending on the writer queue length, the storage is called directly or by the writer
+     * thread.
+     */
+    void processTrigger();
+
+    /**
+     * Process the current trigger in event capture mode: keep the values in the pre-trigger ring or, if an event is
+     * captured, write them to the file.
+     */
+    void captureTrigger(bool writerFailed);
+
+    /**
+     * Main loop shared by all DAQ implementations. Writes the initial values and then waits for the trigger and all
+     * accessors given in accessorsWithTrigger before processing each trigger.
+     */
+    void runDAQ(detail::DAQStorage<TRIGGERTYPE>& storage, const std::vector<TransferElementID>& accessorsWithTrigger);
+
    private:
     VersionNumber lastVersion{};
     uint64_t lastTrigger{0};
+
+    /** Storage of the DAQ implementation, set while runDAQ() is executed */
+    detail::DAQStorage<TRIGGERTYPE>* _storage{nullptr};
+
+    /** Writer thread, only present if _writerQueueLength > 0 */
+    detail::DAQWriter<TRIGGERTYPE>* _writer{nullptr};
+
+    /** Entry of the writer queue claimed for the current trigger, nullptr if none */
+    detail::DAQCommand<TRIGGERTYPE>* _command{nullptr};
+
+    /** Snapshot passed to the storage in synchronous mode, also used as prototype for the writer queue entries */
+    detail::DAQSnapshot<TRIGGERTYPE> _snapshot;
+
+    bool _isOpened{false};
+    bool _firstTrigger{true};
+
+    /** Estimated size of a single trigger, see estimateBytesPerTrigger() */
+    uint64_t _bytesPerTrigger{0};
+
+    /** Time of the first trigger written to the current file, used for maxFileDuration */
+    std::chrono::system_clock::time_point _fileStartTime;
+
+    /** Number of triggers processed since the DAQ module was started, the initial values are trigger 0 */
+    uint64_t _triggerNumber{0};
+
+    /** Event capture settings, see enableEventCapture() */
+    bool _eventCapture{false};
+    size_t _nPreTrigger{0}, _nPostTrigger{0};
+
+    /** Ring of the values of the last nPreTrigger triggers, allocated when the DAQ is started */
+    std::vector<detail::DAQSnapshot<TRIGGERTYPE>> _captureRing;
+    size_t _captureNext{0};  ///< Ring index of the next snapshot
+    size_t _captureCount{0}; ///< Number of snapshots in the ring not yet written
+
+    /** Number of post-trigger triggers to be written before the file of the current event is closed */
+    size_t _nPostTriggerRemaining{0};
+
+    /** Version of the event variable seen last, used to detect new events */
+    VersionNumber _lastEventVersion{nullptr};
+
+    /** Claim a writer queue entry for the current trigger, see DAQWriter::claim() */
+    detail::DAQCommand<TRIGGERTYPE>* claimCommand(bool wait);
+
+    /** Pass the claimed writer queue entry to the writer thread, if any */
+    void submitCommand();
+
+    /** Open the given file in the DAQ directory. Returns false if the file could not be opened. */
+    bool requestOpen(const std::string& fileName);
+
+    /** Variables recorded in the next file, evaluated from the patterns below */
+    decltype(detail::FileSettings::recorded) _recordedMask;
+
+    /** Patterns of includeVariables and excludeVariables _recordedMask was evaluated from */
+    std::optional<std::pair<std::string, std::string>> _maskPatterns;
+
     /**
-     * Delete file corresponding to currentBuffer from the ringbuffer.
+     * Fill the variables recorded in the next file into the file settings. The mask is only evaluated again if
+     * includeVariables or excludeVariables have changed.
      */
-    void deleteRingBufferFile();
+    void updateRecordedMask(detail::FileSettings& settings);
+
+    /**
+     * Write the current values. If the writer queue is full, the values are dropped unless wait is true, in which case
+     * the function waits for a free queue entry. Returns false if the values have not been written or queued.
+     */
+    bool requestWrite(bool wait = false);
+
+    /**
+     * Write values kept in the given snapshot. Waits for a free queue entry if the writer queue is full. The content
+     * of the snapshot is undefined afterwards.
+     */
+    void requestWrite(detail::DAQSnapshot<TRIGGERTYPE>& snapshot);
+
+    /** Close the current file. */
+    void requestClose();
+
+    /** Fill the trigger information and the version numbers of the variables of the snapshot. */
+    void fillSnapshotInfo(detail::DAQSnapshot<TRIGGERTYPE>& snapshot);
+
+    /** Fill the snapshot with the trigger information and a copy of the current values. */
+    void copyToSnapshot(detail::DAQSnapshot<TRIGGERTYPE>& snapshot);
+
+    /**
+     * Increase currentBuffer and reset currentEntry after a file is completed, nextBuffer will check buffer size.
+     */
+    void finishBuffer();
+
+    /** File names of the ring buffer slots, empty if a slot is unused. Persisted in the currentBuffer file. */
+    std::vector<std::string> _bufferFiles;
+
+    /** DAQ directory _bufferFiles belongs to */
+    boost::filesystem::path _bufferFilesPath;
+
+    /**
+     * Read the buffer number and the file names of the ring buffer slots from the currentBuffer file of the DAQ
+     * directory. Files without the slot index (written by previous versions) are completed by scanning the directory
+     * once. Returns the buffer number, if stored.
+     */
+    std::optional<uint32_t> loadBufferIndex();
+
+    /**
+     * Atomically replace the currentBuffer file by the current buffer number and the file names of the slots.
+     */
+    void saveBufferIndex();
+
+    /**
+     * File name stored for the given slot of the ring buffer in the current DAQ directory.
+     */
+    std::string& bufferFile(uint32_t slot);
+
+    /** Retention thread keeping the disk usage limits, set while runDAQ() is executed */
+    detail::DiskRetention* _retention{nullptr};
+
+    /** Limits passed to the retention thread last */
+    detail::RetentionSettings _retentionSettings;
+
+    /** Number of files created by nextBuffer() since the writer thread was started */
+    uint64_t _nQueuedFiles{0};
+
+    /** Number of newest files passed to the retention thread last which must not be removed */
+    size_t _nRetentionKeep{1};
+
+    /**
+     * Number of newest ring buffer files which may still be written: the current file and, with the writer thread,
+     * all previous files the writer thread has not closed yet.
+     */
+    size_t nUnclosedFiles() const;
+
+    /**
+     * Pass the ring buffer files, oldest first, and the disk usage limits to the retention thread. Files removed by
+     * the retention thread are dropped from the ring buffer index.
+     */
+    void updateRetention();
+
+    /**
+     * Pass changed disk usage limits to the retention thread and publish its measurements. Called once per trigger.
+     */
+    void updateRetentionStatus();
+
+    /** Removal of the file replaced at the last rollover, running in the background */
+    std::future<void> _fileRemoval;
+
+    /**
+     * Delete file corresponding to currentBuffer from the ringbuffer. The file is removed in the background, since
+     * removing large files can take long. It is kept if it has the same name as the next file, which truncates it.
+     */
+    void deleteRingBufferFile(const std::string& nextFileName);
 
     /**
      * Check if ringbuffer file corresponding to currentBuffer exists.
      *
-     * Since timestamps are prefixed to the buffer files here we check
-     * the last part of the file.
-     *
      * \return True if file with currentBuffer number exists.
      */
     bool checkFile();
@@ -270,13 +653,18 @@ namespace ChimeraTK {
   template<typename TRIGGERTYPE>
   template<typename UserType>
   bool BaseDAQ<TRIGGERTYPE>::isAccessorUsingDAQTrigger(const ArrayPushInput<UserType>& accessor) {
-    // Obtain the path of the trigger for the given accessor (stays empty if no trigger)
-    std::string triggerPath;
-    auto visitor = [&](const Model::DeviceModuleProxy& dev) { triggerPath = dev.getTrigger().getFullyQualifiedPath(); };
+    if(_daqTriggerPath.empty()) _daqTriggerPath = trigger.getModel().getFullyQualifiedPath();
+
+    // Find the device module feeding the accessor (none if not fed by a device) and compare its trigger to the DAQ
+    // trigger. Many accessors share the same device module, so the trigger is only resolved once per device module.
+    bool usingDAQTrigger = false;
+    auto visitor = [&](const Model::DeviceModuleProxy& dev) {
+      auto [entry, isNew] = _deviceUsesDAQTrigger.try_emplace(dev.getAliasOrCdd(), false);
+      if(isNew) entry->second = (dev.getTrigger().getFullyQualifiedPath() == _daqTriggerPath);
+      usingDAQTrigger = entry->second;
+    };
     accessor.getModel().visit(visitor, Model::keepDeviceModules, Model::adjacentInSearch, Model::keepPvAccess);
-
-    // compare to the path of the DAQ trigger
-    return triggerPath == trigger.getModel().getFullyQualifiedPath();
+    return usingDAQTrigger;
   }
 
   /********************************************************************************************************************/
@@ -303,17 +691,18 @@ namespace ChimeraTK {
     std::string daqName = namePrefix / name.substr(submodule.length());
 
     // check for name collision
-    if(_overallVariableList.count(daqName) > 0) {
+    if(!_overallVariableList.insert(daqName).second) {
       // Can happen if a pv is added in the logical name mapping process twice, e.g. to use math plugin
       return;
     }
-    _overallVariableList.insert(daqName);
 
     // create accessor and fill lists
     callForTypeNoVoid(type, [&](auto t) {
       using UserType = decltype(t);
       boost::fusion::at_key<UserType>(_nameListMap.table).push_back(daqName);
       boost::fusion::at_key<UserType>(_accessorListMap.table).emplace_back(this, name, "", length, "");
+      boost::fusion::at_key<UserType>(_decimationListMap.table).push_back(resolveDecimation(daqName, length));
+      boost::fusion::at_key<UserType>(_rateGroupListMap.table).push_back(resolveRateGroup(daqName, pv.getTags()));
     });
   }
 
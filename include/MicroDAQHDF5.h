@@ -22,6 +22,8 @@ namespace ChimeraTK {
     template<typename TRIGGERTYPE>
     struct H5DataSpaceCreator;
     template<typename TRIGGERTYPE>
+    struct H5DataSetCreator;
+    template<typename TRIGGERTYPE>
     struct H5DataWriter;
   } // namespace detail
 
@@ -52,11 +54,83 @@ namespace ChimeraTK {
      * initialisation. */
     HDF5DAQ() : BaseDAQ<TRIGGERTYPE>() {}
 
+    ScalarPollInput<ChimeraTK::Boolean> appendMode{this, "appendMode", "",
+        "Store each variable in a single extendible data set, to which one row is appended per trigger, instead of "
+        "creating a new group per trigger. Trigger number and time stamp are stored in the MicroDAQ group. Changes "
+        "are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> convertToFloat{this, "convertToFloat", "",
+        "Convert all data to float before writing, as done by previous versions of the HDF5DAQ. If not set, the native "
+        "HDF5 type matching the variable type is used. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<std::string> compressionAlgorithm{this, "compressionAlgorithm", "",
+        "Compression algorithm applied to all data sets: 'none' (or empty), 'deflate', 'lzf' or 'zstd'. LZF and "
+        "Zstandard require the corresponding HDF5 filter plugin, otherwise deflate is used. Changes are applied when "
+        "the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> compressionLevel{this, "compressionLevel", "",
+        "Compression level passed to the compression algorithm (deflate: 0-9, zstd: 1-22). Changes are applied when "
+        "the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> shuffle{this, "shuffle", "",
+        "Apply the byte shuffle filter before compression, which usually improves the compression ratio of numeric "
+        "data. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> flushAfterNEntries{this, "flushAfterNEntries", "",
+        "Number of triggers accumulated in memory before they are written with a single write per data set (append "
+        "mode only). Staged triggers are always written when the file is closed. Values of 0 and 1 write each "
+        "trigger immediately. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> swmrMode{this, "swmrMode", "",
+        "Create files using the latest HDF5 file format in single-writer/multiple-reader (SWMR) mode, so the file "
+        "currently written can be read by other processes (append mode only). Changes are applied when the next file "
+        "is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> swmrFlushPeriod{this, "swmrFlushPeriod", "",
+        "Number of triggers after which the file is flushed in SWMR mode, so readers can see the new data. Values of 0 "
+        "and 1 flush after each written trigger. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> compressionThreads{this, "compressionThreads", "",
+        "Number of threads compressing chunks in parallel, which are then written directly to the file (append mode "
+        "with deflate compression only). With 0 the HDF5 library compresses the data while writing. Changes are "
+        "applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> timeAttribute{this, "timeAttribute", "",
+        "Add the local time of the trigger as human-readable attribute 'time' to each trigger group (not used in "
+        "append mode). Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> changeOnlyScalars{this, "changeOnlyScalars", "",
+        "Store scalars only for triggers at which they were updated (append mode only). The data set of each scalar "
+        "then contains only the updated values, the data set '<name>_row' the corresponding rows of "
+        "MicroDAQ/triggerNumber. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> compoundScalars{this, "compoundScalars", "",
+        "Pack all scalars except strings into one compound record per trigger, appended to the data set "
+        "MicroDAQ/scalars, instead of one data set per scalar (append mode only, not combined with changeOnlyScalars "
+        "or convertToFloat). Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarOutput<float> compressionRatio{&this->status, "compressionRatio", "",
+        "Ratio of the uncompressed data size to the size of the last closed file.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
    protected:
     void mainLoop() override;
 
     friend struct detail::H5storage<TRIGGERTYPE>;
     friend struct detail::H5DataSpaceCreator<TRIGGERTYPE>;
+    friend struct detail::H5DataSetCreator<TRIGGERTYPE>;
     friend struct detail::H5DataWriter<TRIGGERTYPE>;
   };
 
@@ -0,0 +1,80 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#pragma once
+
+#include "MicroDAQ.h"
+
+#include <ChimeraTK/ApplicationCore/ArrayAccessor.h>
+#include <ChimeraTK/ApplicationCore/VariableGroup.h>
+#include <ChimeraTK/SupportedUserTypes.h>
+
+namespace ChimeraTK {
+
+  namespace detail {
+    template<typename TRIGGERTYPE>
+    struct RNTupleStorage;
+    template<typename TRIGGERTYPE>
+    struct RNTupleFieldCreator;
+
+  } // namespace detail
+
+  /********************************************************************************************************************/
+
+  /**
+   *  MicroDAQ module for logging data to ROOT files using the columnar RNTuple format. Each DAQ variable is stored in
+   *  a field named like the variable in the DAQ (e.g. "Dummy/out"), arrays as fixed-size std::array. Which variables
+   *  should be logged can be selected through EntityOwner::findTag().
+   */
+  template<typename TRIGGERTYPE = int32_t>
+  class RNTupleDAQ : public BaseDAQ<TRIGGERTYPE> {
+   public:
+    /**
+     *  Constructor. decimationFactor and decimationThreshold are configuration
+     * constants which determine how the data reduction is working. Arrays with a
+     * size bigger than decimationThreshold will be decimated by decimationFactor
+     * before writing to the file.
+     */
+    RNTupleDAQ(ModuleGroup* owner, const std::string& name, const std::string& description,
+        uint32_t decimationFactor = 10, uint32_t decimationThreshold = 1000,
+        const std::unordered_set<std::string>& tags = {}, const std::string& pathToTrigger = "trigger",
+        const std::string& ntupleName = "data")
+    : BaseDAQ<TRIGGERTYPE>(
+          owner, name, description, ".root", decimationFactor, decimationThreshold, tags, pathToTrigger),
+      _ntupleName(ntupleName) {}
+
+    /** Default constructor, creates a non-working module. Can be used for late
+     * initialisation. */
+    RNTupleDAQ() : BaseDAQ<TRIGGERTYPE>() {}
+
+    ScalarPollInput<uint32_t> flushAfterNEntries{this, "flushAfterNEntries", "",
+        "Number of entries after which the current cluster is written to the file. Otherwise clusters are written "
+        "when they reach the size chosen by ROOT. This is ignored if value is 0. Changes are applied when the next "
+        "file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<std::string> compressionAlgorithm{this, "compressionAlgorithm", "",
+        "Compression algorithm of the RNTuple: 'none', 'zlib', 'lzma', 'lz4' or 'zstd' (default if empty). Changes "
+        "are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> compressionLevel{this, "compressionLevel", "",
+        "Compression level passed to the compression algorithm (1-9). The default level of the algorithm is used if "
+        "0. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+   protected:
+    void mainLoop() override;
+
+    std::string _ntupleName;
+
+    friend struct detail::RNTupleStorage<TRIGGERTYPE>;
+    friend struct detail::RNTupleFieldCreator<TRIGGERTYPE>;
+  };
+
+  /********************************************************************************************************************/
+
+  DECLARE_TEMPLATE_FOR_CHIMERATK_USER_TYPES_NO_VOID(RNTupleDAQ);
+
+  /********************************************************************************************************************/
+
+} // namespace ChimeraTK
@@ -61,6 +61,42 @@ namespace ChimeraTK {
     ScalarPollInput<uint32_t> flushAfterNEntries{this, "flushAfterNEntries", "",
         "Number of entries to be accumulated before writing to file. This is ignored if value is 0."};
 
+    ScalarPollInput<uint32_t> autoSavePeriod{this, "autoSavePeriod", "s",
+        "Minimum time between saving the tree header when flushing after flushAfterNEntries entries, in between only "
+        "the baskets are written. The header is saved with each flush if 0. Changes are applied when the next file is "
+        "opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<std::string> compressionAlgorithm{this, "compressionAlgorithm", "",
+        "Compression algorithm of the ROOT file: 'none', 'zlib', 'lzma', 'lz4' or 'zstd' (default if empty). Changes "
+        "are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> compressionLevel{this, "compressionLevel", "",
+        "Compression level passed to the compression algorithm (1-9). The default level of the algorithm is used if "
+        "0. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> compressionThreads{this, "compressionThreads", "",
+        "Number of threads of ROOT's implicit multithreading, which compresses the baskets of a cluster in parallel. "
+        "Implicit multithreading is process-wide and disabled if 0. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<uint32_t> clusterSize{this, "clusterSize", "kB",
+        "Uncompressed size of the entries written to the file together (auto-flush). The number of entries per "
+        "cluster and the basket size of each branch are derived from it and the estimated size of a trigger. The "
+        "ROOT defaults are used if 0. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarPollInput<ChimeraTK::Boolean> compoundScalars{this, "compoundScalars", "",
+        "Pack all scalars except strings into the single branch MicroDAQ.scalars with one leaf per scalar, instead of "
+        "one branch per scalar. Changes are applied when the next file is opened.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
+    ScalarOutput<float> flushLatency{&this->status, "flushLatency", "ms",
+        "Duration of the last flush of the ROOT file, which is done in the background.",
+        {BaseDAQ<TRIGGERTYPE>::_tagExcludeInternals}};
+
    protected:
     void mainLoop() override;
 
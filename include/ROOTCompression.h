@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#pragma once
+
+#include "Compression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace ChimeraTK { namespace detail {
+
+  /********************************************************************************************************************/
+
+  /**
+   * ROOT compression settings for the given algorithm ('none', 'zlib', 'lzma', 'lz4' or 'zstd') and level. Zstandard
+   * is used if the algorithm is empty or unknown, the default level of the algorithm if the level is 0. Used by the
+   * RootDAQ and the RNTupleDAQ.
+   */
+  inline int rootCompressionSettings(std::string algorithm, uint32_t compressionLevel) {
+    std::transform(
+        algorithm.begin(), algorithm.end(), algorithm.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if(algorithm == "none") return ROOT::RCompressionSetting::ELevel::kUncompressed;
+
+    using Algorithm = ROOT::RCompressionSetting::EAlgorithm;
+    using Level = ROOT::RCompressionSetting::ELevel;
+    auto value = Algorithm::kZSTD;
+    int level = Level::kDefaultZSTD;
+    if(algorithm == "zlib") {
+      value = Algorithm::kZLIB;
+      level = Level::kDefaultZLIB;
+    }
+    else if(algorithm == "lzma") {
+      value = Algorithm::kLZMA;
+      level = Level::kDefaultLZMA;
+    }
+    else if(algorithm == "lz4") {
+      value = Algorithm::kLZ4;
+      level = Level::kDefaultLZ4;
+    }
+    else if(!algorithm.empty() && algorithm != "zstd") {
+      std::cerr << "MicroDAQ: Unknown ROOT compression algorithm '" << algorithm << "'. Using zstd instead."
+                << std::endl;
+    }
+    if(compressionLevel > 0) level = static_cast<int>(std::min(compressionLevel, 9U));
+    return ROOT::CompressionSettings(value, level);
+  }
+
+  /********************************************************************************************************************/
+
+}} // namespace ChimeraTK::detail
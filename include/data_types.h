@@ -8,103 +8,62 @@
  *      Author: Klaus Zenker (HZDR)
  */
 
-#include "TArrayC.h"
-#include "TArrayD.h"
-#include "TArrayF.h"
-#include "TArrayI.h"
-#include "TArrayL.h"
-#include "TArrayS.h"
-#include "TDatime.h"
-#include "TString.h"
-
 #include <ChimeraTK/SupportedUserTypes.h>
 
-#include <map>
+#include <cstdint>
 #include <string>
 
 /** MicroDAQ related data types */
 namespace ChimeraTK { namespace detail {
-  /* Add TArray for std::string since it is needed
-   * for the TreeDataFields template specialization.
+  /**
+   * Type code of the ROOT leaf matching the ChimeraTK data type, used to create branches reading the values directly
+   * from the DAQ buffers. std::string has no leaf type, it is stored as std::string or std::vector<std::string>.
    */
-  class TArrayStr : public TArray {
-   private:
-    std::vector<std::string> _buffer;
-
-   public:
-    Double_t GetAt(Int_t i) const override { return std::stod(_buffer.at(i)); }
-    void Set(Int_t i) override {
-      _buffer.resize(i);
-      fN = i;
-    }
-    void SetAt(Double_t, Int_t) override {}
-    std::string& operator[](Int_t i) { return _buffer.at(i); }
-    std::string operator[](Int_t i) const { return _buffer.at(i); }
-    std::string At(Int_t i) const { return _buffer.at(i); }
-  };
-
   template<typename UserType>
-  struct TreeDataFields {};
+  struct LeafType {};
   template<>
-  struct TreeDataFields<float> {
-    std::map<std::string, Float_t> parameter;
-    std::map<std::string, TArrayF> trace;
+  struct LeafType<int8_t> {
+    static constexpr char code = 'B';
   };
   template<>
-  struct TreeDataFields<double> {
-    std::map<std::string, Double_t> parameter;
-    std::map<std::string, TArrayD> trace;
+  struct LeafType<uint8_t> {
+    static constexpr char code = 'b';
   };
   template<>
-  struct TreeDataFields<uint8_t> {
-    std::map<std::string, UChar_t> parameter;
-    std::map<std::string, TArrayS> trace;
+  struct LeafType<int16_t> {
+    static constexpr char code = 'S';
   };
   template<>
-  struct TreeDataFields<int8_t> {
-    std::map<std::string, Char_t> parameter;
-    std::map<std::string, TArrayS> trace;
+  struct LeafType<uint16_t> {
+    static constexpr char code = 's';
   };
   template<>
-  struct TreeDataFields<uint16_t> {
-    std::map<std::string, UShort_t> parameter;
-    std::map<std::string, TArrayS> trace;
+  struct LeafType<int32_t> {
+    static constexpr char code = 'I';
   };
   template<>
-  struct TreeDataFields<int16_t> {
-    std::map<std::string, Short_t> parameter;
-    std::map<std::string, TArrayS> trace;
+  struct LeafType<uint32_t> {
+    static constexpr char code = 'i';
   };
   template<>
-  struct TreeDataFields<uint32_t> {
-    std::map<std::string, UInt_t> parameter;
-    std::map<std::string, TArrayI> trace;
+  struct LeafType<int64_t> {
+    static constexpr char code = 'L';
   };
   template<>
-  struct TreeDataFields<int32_t> {
-    std::map<std::string, Int_t> parameter;
-    std::map<std::string, TArrayI> trace;
+  struct LeafType<uint64_t> {
+    static constexpr char code = 'l';
   };
   template<>
-  struct TreeDataFields<uint64_t> {
-    std::map<std::string, ULong64_t> parameter;
-    std::map<std::string, TArrayL> trace;
+  struct LeafType<float> {
+    static constexpr char code = 'F';
   };
   template<>
-  struct TreeDataFields<int64_t> {
-    std::map<std::string, Long64_t> parameter;
-    std::map<std::string, TArrayL> trace;
+  struct LeafType<double> {
+    static constexpr char code = 'D';
   };
-
-  template<>
-  struct TreeDataFields<std::string> {
-    std::map<std::string, std::string> parameter;
-    std::map<std::string, TArrayStr> trace;
-  };
-
   template<>
-  struct TreeDataFields<Boolean> {
-    std::map<std::string, Bool_t> parameter;
-    std::map<std::string, TArrayC> trace;
+  struct LeafType<Boolean> {
+    static_assert(sizeof(Boolean) == sizeof(bool), "ChimeraTK::Boolean must have the layout of bool");
+    static constexpr char code = 'O';
   };
 }} // namespace ChimeraTK::detail
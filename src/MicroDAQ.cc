@@ -11,14 +11,15 @@
 
 #include <ChimeraTK/ApplicationCore/DeviceModule.h>
 
-#include <boost/algorithm/string.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
 
+#include <fnmatch.h>
 #include <string.h>
+#include <time.h>
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #ifdef ENABLE_HDF5
@@ -27,6 +28,9 @@
 #ifdef ENABLE_ROOT
 #  include "MicroDAQROOT.h"
 #endif
+#ifdef ENABLE_RNTUPLE
+#  include "MicroDAQRNTuple.h"
+#endif
 
 namespace ChimeraTK {
 
@@ -62,28 +66,167 @@ namespace ChimeraTK {
           this, name, description, decimationFactor, decimationThreshold, tags, pathToTrigger);
 #else
       throw ChimeraTK::logic_error("MicroDAQ: Output format ROOT selected but not compiled in.");
+#endif
+    }
+    else if(type == "rntuple") {
+#ifdef ENABLE_RNTUPLE
+      impl = std::make_shared<RNTupleDAQ<TRIGGERTYPE>>(
+          this, name, description, decimationFactor, decimationThreshold, tags, pathToTrigger);
+#else
+      throw ChimeraTK::logic_error("MicroDAQ: Output format RNTuple selected but not compiled in.");
 #endif
     }
     else {
       throw ChimeraTK::logic_error("MicroDAQ: Unknown output format specified in config file: '" + type + "'.");
     }
 
+    // optional: asynchronous writing
+    try {
+      impl->setWriterQueueLength(appConfig().template get<uint32_t>("Configuration/MicroDAQ/writerQueueLength"));
+    }
+    catch(ChimeraTK::logic_error&) {
+      // not configured, write synchronously
+    }
+
+    // optional: event capture, pre- and post-trigger lengths are required if the event is configured
+    std::string eventPath;
+    try {
+      eventPath = appConfig().template get<std::string>("Configuration/MicroDAQ/eventCapture/event");
+    }
+    catch(ChimeraTK::logic_error&) {
+      // not configured, write continuously
+    }
+    if(!eventPath.empty()) {
+      impl->enableEventCapture(eventPath,
+          appConfig().template get<uint32_t>("Configuration/MicroDAQ/eventCapture/nPreTrigger"),
+          appConfig().template get<uint32_t>("Configuration/MicroDAQ/eventCapture/nPostTrigger"));
+    }
+
+    // decimation and rate groups must be known before the variables are added
+    readDecimationConfig();
+    readRateGroupConfig();
+
     // connect input data with the DAQ implementation
     impl->addSource(".", inputTag);
   }
 
   /********************************************************************************************************************/
 
+  namespace {
+    DecimationMode decimationModeFromString(const std::string& mode) {
+      if(mode == "pick") return DecimationMode::pick;
+      if(mode == "mean") return DecimationMode::mean;
+      if(mode == "minMax") return DecimationMode::minMax;
+      if(mode == "peak") return DecimationMode::peak;
+      throw ChimeraTK::logic_error("MicroDAQ: Unknown decimation mode specified in config file: '" + mode + "'.");
+    }
+  } // namespace
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void MicroDAQ<TRIGGERTYPE>::readDecimationConfig() {
+    const std::string prefix = "Configuration/MicroDAQ/decimation";
+
+    std::string mode;
+    try {
+      mode = appConfig().template get<std::string>(prefix + "Mode");
+    }
+    catch(ChimeraTK::logic_error&) {
+      // not configured, keep pick
+    }
+    if(!mode.empty()) impl->setDecimationMode(decimationModeFromString(mode));
+
+    std::vector<std::string> patterns;
+    try {
+      patterns = appConfig().template get<std::vector<std::string>>(prefix + "/pattern");
+    }
+    catch(ChimeraTK::logic_error&) {
+      return; // no decimation rules configured
+    }
+
+    // all other columns of the rules are optional, but must have one entry per pattern if given
+    auto getColumn = [&](const std::string& name, auto defaultValue) {
+      using T = decltype(defaultValue);
+      std::vector<T> column;
+      try {
+        column = appConfig().template get<std::vector<T>>(prefix + "/" + name);
+      }
+      catch(ChimeraTK::logic_error&) {
+        return std::vector<T>(patterns.size(), defaultValue);
+      }
+      if(column.size() != patterns.size()) {
+        throw ChimeraTK::logic_error("MicroDAQ: Config variable " + prefix + "/" + name + " has " +
+            std::to_string(column.size()) + " entries, but " + std::to_string(patterns.size()) + " are expected.");
+      }
+      return column;
+    };
+    auto factors = getColumn("factor", uint32_t(0));
+    auto modes = getColumn("mode", std::string());
+    auto roiBegins = getColumn("roiBegin", uint32_t(0));
+    auto roiLengths = getColumn("roiLength", uint32_t(0));
+
+    for(size_t i = 0; i < patterns.size(); ++i) {
+      DecimationRule rule{patterns[i], factors[i], std::nullopt, roiBegins[i], roiLengths[i]};
+      if(!modes[i].empty()) rule.mode = decimationModeFromString(modes[i]);
+      impl->addDecimationRule(rule);
+    }
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void MicroDAQ<TRIGGERTYPE>::readRateGroupConfig() {
+    const std::string prefix = "Configuration/MicroDAQ/rateGroup/";
+
+    std::vector<std::string> names;
+    try {
+      names = appConfig().template get<std::vector<std::string>>(prefix + "name");
+    }
+    catch(ChimeraTK::logic_error&) {
+      return; // no rate groups configured
+    }
+
+    // everyNthTrigger is required, pattern and tag are optional but must have one entry per group if given
+    auto getColumn = [&](const std::string& name, auto defaultValue, bool required) {
+      using T = decltype(defaultValue);
+      std::vector<T> column;
+      try {
+        column = appConfig().template get<std::vector<T>>(prefix + name);
+      }
+      catch(ChimeraTK::logic_error&) {
+        if(required) throw;
+        return std::vector<T>(names.size(), defaultValue);
+      }
+      if(column.size() != names.size()) {
+        throw ChimeraTK::logic_error("MicroDAQ: Config variable " + prefix + name + " has " +
+            std::to_string(column.size()) + " entries, but " + std::to_string(names.size()) + " are expected.");
+      }
+      return column;
+    };
+    auto everyNthTrigger = getColumn("everyNthTrigger", uint32_t(1), true);
+    auto patterns = getColumn("pattern", std::string(), false);
+    auto tags = getColumn("tag", std::string(), false);
+
+    for(size_t i = 0; i < names.size(); ++i) {
+      impl->addRateGroup({names[i], everyNthTrigger[i], patterns[i], tags[i]});
+    }
+  }
+
+  /********************************************************************************************************************/
+
   template<typename TRIGGERTYPE>
   void MicroDAQ<TRIGGERTYPE>::addDeviceModule(
       DeviceModule& source, const RegisterPath& namePrefix, const RegisterPath& submodule) {
     if(impl) {
+      auto start = std::chrono::steady_clock::now();
       std::vector<Model::ProcessVariableProxy> pvs;
       source.getModel().visit([&](auto pv) { pvs.emplace_back(pv); }, Model::keepPvAccess, Model::adjacentSearch,
           Model::keepProcessVariables);
       for(auto pv : pvs) {
         impl->addVariableFromModel(pv, namePrefix, submodule);
       }
+      impl->_startupTimes.addVariables += std::chrono::steady_clock::now() - start;
     }
   }
 
@@ -91,6 +234,7 @@ namespace ChimeraTK {
 
   template<typename TRIGGERTYPE>
   void BaseDAQ<TRIGGERTYPE>::addSource(const std::string& qualifiedDirectoryPath, const std::string& inputTag) {
+    auto start = std::chrono::steady_clock::now();
     auto model = dynamic_cast<ModuleGroup*>(_owner)->getModel();
     auto neighbourDir = model.visit(ChimeraTK::Model::returnDirectory, ChimeraTK::Model::getNeighbourDirectory,
         ChimeraTK::Model::returnFirstHit(ChimeraTK::Model::DirectoryProxy{}));
@@ -110,6 +254,7 @@ namespace ChimeraTK {
     for(auto pv : pvs) {
       addVariableFromModel(pv);
     }
+    _startupTimes.addVariables += std::chrono::steady_clock::now() - start;
 
     if(!found) {
       throw ChimeraTK::logic_error("Path passed to BaseDAQ<TRIGGERTYPE>::addSource() not found!");
@@ -139,52 +284,114 @@ namespace ChimeraTK {
   /********************************************************************************************************************/
 
   template<typename TRIGGERTYPE>
-  bool BaseDAQ<TRIGGERTYPE>::checkFile() {
+  std::optional<uint32_t> BaseDAQ<TRIGGERTYPE>::loadBufferIndex() {
+    _bufferFiles.clear();
+    _bufferFilesPath = _daqPath;
+
+    // first line: buffer number, followed by one line "<slot> <file name>" per used slot
+    std::optional<uint32_t> currentBuffer;
+    std::ifstream bufferNumber((_daqPath / "currentBuffer").c_str());
+    uint32_t value;
+    if(bufferNumber >> value) currentBuffer = value;
+    uint32_t slot;
+    std::string fileName;
+    bool hasIndex = false;
+    while(bufferNumber >> slot >> fileName) {
+      bufferFile(slot) = fileName;
+      hasIndex = true;
+    }
+    if(!currentBuffer || hasIndex) return currentBuffer;
+
+    // written by a previous version without index: find the files of all slots once
     try {
-      if(boost::filesystem::exists(_daqPath)) {         // does p actually exist?
-        if(boost::filesystem::is_directory(_daqPath)) { // is p a directory?
-          for(auto i = boost::filesystem::directory_iterator(_daqPath); i != boost::filesystem::directory_iterator();
-              i++) {
-            std::string match = (boost::format("buffer%04d%s") % status.currentBuffer % _suffix).str();
-            if(boost::filesystem::canonical(i->path()).string().find(match) != std::string::npos) {
-              return boost::filesystem::file_size(i->path()) > 1000;
-            }
-          }
+      for(auto i = boost::filesystem::directory_iterator(_daqPath); i != boost::filesystem::directory_iterator(); i++) {
+        // file names end with _buffer%04d followed by the suffix
+        auto name = i->path().filename().string();
+        size_t tail = _suffix.size() + 4;
+        if(name.size() < tail + 7 || name.compare(name.size() - _suffix.size(), _suffix.size(), _suffix) != 0 ||
+            name.compare(name.size() - tail - 7, 7, "_buffer") != 0) {
+          continue;
+        }
+        auto digits = name.substr(name.size() - tail, 4);
+        if(std::all_of(digits.begin(), digits.end(), [](unsigned char c) { return std::isdigit(c); })) {
+          bufferFile(std::stoul(digits)) = name;
         }
       }
     }
     catch(const boost::filesystem::filesystem_error& ex) {
-      std::cout << "Checking existing buffer file failed:" << std::endl;
-      std::cout << ex.what() << std::endl;
+      std::cerr << "Scanning DAQ directory for buffer files failed:" << std::endl;
+      std::cerr << ex.what() << std::endl;
     }
-    return false;
+    return currentBuffer;
   }
 
   /********************************************************************************************************************/
 
   template<typename TRIGGERTYPE>
-  void BaseDAQ<TRIGGERTYPE>::deleteRingBufferFile() {
-    try {
-      if(boost::filesystem::exists(_daqPath)) {
-        if(boost::filesystem::is_directory(_daqPath)) {
-          for(auto i = boost::filesystem::directory_iterator(_daqPath); i != boost::filesystem::directory_iterator();
-              i++) {
-            std::string match = (boost::format("buffer%04d%s") % status.currentBuffer % _suffix).str();
-            if(boost::filesystem::canonical(i->path()).string().find(match) != std::string::npos) {
-              boost::filesystem::remove(i->path());
-            }
-          }
-        }
+  void BaseDAQ<TRIGGERTYPE>::saveBufferIndex() {
+    // write a temporary file and rename it, so the file is always complete
+    auto path = _daqPath / "currentBuffer";
+    auto temporary = _daqPath / "currentBuffer.tmp";
+    {
+      std::ofstream bufferNumber(temporary.c_str(), std::ofstream::trunc);
+      bufferNumber << status.currentBuffer << "\n";
+      for(size_t slot = 0; slot < _bufferFiles.size(); ++slot) {
+        if(!_bufferFiles[slot].empty()) bufferNumber << slot << " " << _bufferFiles[slot] << "\n";
+      }
+      if(!bufferNumber.flush()) {
+        std::cerr << "Writing buffer index failed: " << temporary.string() << std::endl;
+        return;
       }
     }
-    catch(const boost::filesystem::filesystem_error& ex) {
-      std::cerr << "Ringbuffer file delete failed:" << std::endl;
-      std::cout << ex.what() << std::endl;
+    boost::system::error_code ec;
+    boost::filesystem::rename(temporary, path, ec);
+    if(ec) {
+      std::cerr << "Replacing buffer index failed: " << ec.message() << std::endl;
     }
   }
 
   /********************************************************************************************************************/
 
+  template<typename TRIGGERTYPE>
+  std::string& BaseDAQ<TRIGGERTYPE>::bufferFile(uint32_t slot) {
+    if(_bufferFilesPath != _daqPath) loadBufferIndex();
+    if(slot >= _bufferFiles.size()) _bufferFiles.resize(slot + 1);
+    return _bufferFiles[slot];
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  bool BaseDAQ<TRIGGERTYPE>::checkFile() {
+    auto& fileName = bufferFile(status.currentBuffer);
+    if(fileName.empty()) return false;
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(_daqPath / fileName, ec);
+    return !ec && size > 1000;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::deleteRingBufferFile(const std::string& nextFileName) {
+    auto& fileName = bufferFile(status.currentBuffer);
+    if(fileName.empty() || fileName == nextFileName) return;
+    auto path = _daqPath / fileName;
+    fileName.clear();
+
+    // the removal started at the previous rollover has finished long ago, so this does not block
+    if(_fileRemoval.valid()) _fileRemoval.get();
+    _fileRemoval = std::async(std::launch::async, [path] {
+      boost::system::error_code ec;
+      boost::filesystem::remove(path, ec);
+      if(ec) {
+        std::cerr << "Ringbuffer file delete failed: " << path.string() << ": " << ec.message() << std::endl;
+      }
+    });
+  }
+
+  /********************************************************************************************************************/
+
   template<typename TRIGGERTYPE>
   void BaseDAQ<TRIGGERTYPE>::checkBufferOnFirstTrigger() {
     setDAQPath();
@@ -197,58 +404,189 @@ namespace ChimeraTK {
       std::cerr << e.what() << std::endl;
       return;
     }
-    std::fstream bufferNumber;
     // determine current buffer number
-    bufferNumber.open((_daqPath / "currentBuffer").c_str(), std::ofstream::in);
-    bufferNumber.seekg(0);
-    if(!bufferNumber.eof()) {
-      bufferNumber >> status.currentBuffer;
-      std::string filename = _prefix + (boost::format("_buffer%04d%s") % status.currentBuffer % _suffix).str();
+    auto currentBuffer = loadBufferIndex();
+    if(currentBuffer) {
+      status.currentBuffer = *currentBuffer;
       if(checkFile()) {
         status.currentBuffer++;
-        status.currentBuffer.write();
       }
       if(status.currentBuffer >= nMaxFiles) {
         status.currentBuffer = 0;
-        status.currentBuffer.write();
       }
     }
     else {
       status.currentBuffer = 0;
-      status.currentBuffer.write();
     }
-    bufferNumber.close();
+    status.currentBuffer.write();
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::updateRetention() {
+    if(!_retention) return;
+
+    // ring order starting after the current slot, so the file of the current slot is the newest
+    std::vector<std::string> files;
+    for(size_t i = 1; i <= _bufferFiles.size(); ++i) {
+      auto& fileName = _bufferFiles[(status.currentBuffer + i) % _bufferFiles.size()];
+      if(!fileName.empty()) files.push_back(fileName);
+    }
+    _retentionSettings = detail::RetentionSettings{maxDiskUsage, minFreeSpace};
+    _nRetentionKeep = nUnclosedFiles();
+    _retention->update(_bufferFilesPath, std::move(files), _retentionSettings, _nRetentionKeep);
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  size_t BaseDAQ<TRIGGERTYPE>::nUnclosedFiles() const {
+    if(!_writer) return 1;
+    // the file opened last by the writer thread is still written, as well as all files queued after it
+    return 1 + static_cast<size_t>(_nQueuedFiles - std::min<uint64_t>(_nQueuedFiles, _writer->nOpenedFiles));
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::updateRetentionStatus() {
+    if(!_retention) return;
+    // also hand over the files again once the writer thread has closed them, so they can be removed
+    if(!_firstTrigger &&
+        (detail::RetentionSettings{maxDiskUsage, minFreeSpace} != _retentionSettings ||
+            nUnclosedFiles() != _nRetentionKeep)) {
+      updateRetention();
+    }
+    uint64_t usedBytes = _retention->usedBytes;
+    if(status.usedBytes != usedBytes) {
+      status.usedBytes = usedBytes;
+      status.usedBytes.write();
+    }
+    int64_t timeToFull = _retention->timeToFull;
+    if(status.timeToFull != timeToFull) {
+      status.timeToFull = timeToFull;
+      status.timeToFull.write();
+    }
   }
 
   /********************************************************************************************************************/
 
   template<typename TRIGGERTYPE>
   std::string BaseDAQ<TRIGGERTYPE>::nextBuffer() {
-    std::vector<std::string> result;
-    // read local time e.g. 20200512T134659.777223
-    std::string timeStampStr(boost::posix_time::to_iso_string(boost::posix_time::microsec_clock::local_time()));
-    // remove sub second part -> 20200512T134659
-    boost::algorithm::split(result, timeStampStr, boost::is_any_of("."));
-    _prefix = result.at(0);
+    // local time of the file creation e.g. 20200512T134659
+    time_t t = time(nullptr);
+    struct tm tmp;
+    localtime_r(&t, &tmp);
+    char timeString[32];
+    strftime(timeString, sizeof(timeString), "%Y%m%dT%H%M%S", &tmp);
+    _prefix = timeString;
 
     if(status.currentBuffer >= nMaxFiles) {
       status.currentBuffer = 0;
       status.currentBuffer.write();
     }
-    std::fstream bufferNumber;
+
+    // slots of files removed by the retention thread are free again
+    if(_retention) {
+      for(auto& removed : _retention->takeRemovedFiles()) {
+        auto slot = std::find(_bufferFiles.begin(), _bufferFiles.end(), removed);
+        if(slot != _bufferFiles.end()) slot->clear();
+      }
+    }
     std::string filename = _prefix + (boost::format("_buffer%04d%s") % status.currentBuffer % _suffix).str();
-    // store current buffer number to disk
-    bufferNumber.open((_daqPath / "currentBuffer").c_str(), std::ofstream::out);
-    bufferNumber << status.currentBuffer << std::endl;
-    bufferNumber.close();
 
-    deleteRingBufferFile();
+    // replace the file of the slot and store current buffer number and index to disk
+    deleteRingBufferFile(filename);
+    bufferFile(status.currentBuffer) = filename;
+    if(_writer) ++_nQueuedFiles;
+    updateRetention();
+    saveBufferIndex();
 
     return filename;
   }
 
   /********************************************************************************************************************/
 
+  template<typename TRIGGERTYPE>
+  detail::DecimationSettings BaseDAQ<TRIGGERTYPE>::resolveDecimation(
+      const std::string& name, size_t nElements) const {
+    // the rule added last takes precedence
+    auto rule = std::find_if(_decimationRules.rbegin(), _decimationRules.rend(),
+        [&](const DecimationRule& r) { return fnmatch(r.pattern.c_str(), name.c_str(), 0) == 0; });
+
+    detail::DecimationSettings settings;
+    if(rule != _decimationRules.rend()) {
+      settings.roiBegin = rule->roiBegin;
+      settings.roiLength = rule->roiLength;
+      settings.mode = rule->mode.value_or(_decimationMode);
+
+      // a region of interest beyond the end of the array is clamped to the last element
+      if(nElements > 0 && settings.roiBegin >= nElements) {
+        std::cerr << "Region of interest of the decimation rule '" << rule->pattern << "' starts at " << rule->roiBegin
+                  << " beyond the end of " << name << " with " << nElements
+                  << " elements, only the last element is stored." << std::endl;
+        settings.roiBegin = nElements - 1;
+      }
+      if(rule->factor > 0) settings.factor = rule->factor;
+    }
+
+    // global decimation applies to the region of interest
+    if((rule == _decimationRules.rend() || rule->factor == 0) && settings.roiSize(nElements) > _decimationThreshold) {
+      settings.factor = _decimationFactor;
+      if(rule == _decimationRules.rend() || !rule->mode) settings.mode = _decimationMode;
+    }
+
+    // a factor above the length would leave no value, e.g. for scalars matching a rule
+    if(settings.roiSize(nElements) < settings.factor) settings.factor = 1;
+    return settings;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::addRateGroup(const RateGroup& group) {
+    if(group.everyNthTrigger == 0) {
+      throw ChimeraTK::logic_error(
+          "BaseDAQ: Rate group '" + group.name + "' must record every nth trigger with n > 0.");
+    }
+    bool exists = std::any_of(
+        _rateGroups.begin(), _rateGroups.end(), [&](const RateGroup& g) { return g.name == group.name; });
+    if(group.name.empty() || group.name.find_first_of("/.") != std::string::npos || exists) {
+      throw ChimeraTK::logic_error(
+          "BaseDAQ: Rate group names must be unique, not empty and without '/' or '.': '" + group.name + "'.");
+    }
+    _rateGroups.push_back(group);
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  size_t BaseDAQ<TRIGGERTYPE>::resolveRateGroup(
+      const std::string& name, const std::unordered_set<std::string>& tags) const {
+    // the group added last takes precedence
+    for(size_t i = _rateGroups.size(); i > 0; --i) {
+      const auto& group = _rateGroups[i - 1];
+      if(!group.pattern.empty() && fnmatch(group.pattern.c_str(), name.c_str(), 0) == 0) return i;
+      if(!group.tag.empty() && tags.count(group.tag) > 0) return i;
+    }
+    return 0;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::enableEventCapture(
+      const std::string& eventPath, size_t nPreTrigger, size_t nPostTrigger) {
+    captureEvent = ScalarPushInput<ChimeraTK::Boolean>{
+        this, eventPath, "", "Starts the capture of an event when written with a non-zero value.", {_tagExcludeInternals}};
+    _eventCapture = true;
+    _nPreTrigger = nPreTrigger;
+    _nPostTrigger = nPostTrigger;
+  }
+
+  /********************************************************************************************************************/
+
   template<typename TRIGGERTYPE>
   void BaseDAQ<TRIGGERTYPE>::updateDAQPath() {
     if(enable == 0) {
@@ -265,15 +603,57 @@ namespace ChimeraTK {
 
   template<typename TRIGGERTYPE>
   bool BaseDAQ<TRIGGERTYPE>::maxEntriesReached() {
-    if(status.currentEntry == nTriggersPerFile) {
-      // increase current buffer number, nextBuffer will check buffer size
-      status.currentBuffer++;
-      status.currentBuffer.write();
-      status.currentEntry = 0;
-      status.currentEntry.write();
-      return true;
+    bool reached = nTriggersPerFile > 0 && status.currentEntry >= nTriggersPerFile;
+    if(maxFileSize > 0 && uint64_t(status.currentEntry) * _bytesPerTrigger >= maxFileSize) {
+      reached = true;
+    }
+    if(maxFileDuration > 0 &&
+        trigger.getVersionNumber().getTime() - _fileStartTime >= std::chrono::seconds(maxFileDuration)) {
+      reached = true;
     }
-    return false;
+    if(reached) finishBuffer();
+    return reached;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  uint64_t BaseDAQ<TRIGGERTYPE>::estimateBytesPerTrigger() const {
+    // internal data: trigger number, time stamp, number of missed triggers and trigger period
+    uint64_t bytes = 4 * sizeof(int64_t);
+
+    // bytes of each rate group (index 0: recorded on each trigger), rate groups add trigger number and time stamp
+    std::vector<uint64_t> groupBytes(_rateGroups.size() + 1, 2 * sizeof(int64_t));
+    groupBytes[0] = 0;
+    boost::fusion::for_each(_accessorListMap.table, [&](auto& pair) {
+      using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+      // the size of strings is unknown, assume short strings
+      constexpr uint64_t elementSize = std::is_same<UserType, std::string>::value ? 16 : sizeof(UserType);
+      auto decimation = boost::fusion::at_key<UserType>(_decimationListMap.table).begin();
+      auto rateGroup = boost::fusion::at_key<UserType>(_rateGroupListMap.table).begin();
+      for(auto& accessor : pair.second) {
+        // same length as computed by the Decimator
+        auto settings = *decimation;
+        if(!std::is_arithmetic_v<UserType>) settings.mode = DecimationMode::pick;
+        groupBytes[*rateGroup] += elementSize * settings.length(settings.roiSize(accessor.getNElements()));
+        ++decimation;
+        ++rateGroup;
+      }
+    });
+    bytes += groupBytes[0];
+    for(size_t i = 0; i < _rateGroups.size(); ++i) bytes += groupBytes[i + 1] / _rateGroups[i].everyNthTrigger;
+    return bytes;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::finishBuffer() {
+    // increase current buffer number, nextBuffer will check buffer size
+    status.currentBuffer++;
+    status.currentBuffer.write();
+    status.currentEntry = 0;
+    status.currentEntry.write();
   }
 
   /********************************************************************************************************************/
@@ -317,6 +697,403 @@ namespace ChimeraTK {
 
   /********************************************************************************************************************/
 
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::runDAQ(
+      detail::DAQStorage<TRIGGERTYPE>& storage, const std::vector<TransferElementID>& accessorsWithTrigger) {
+    auto start = std::chrono::steady_clock::now();
+    _storage = &storage;
+
+    // allocate the snapshot buffers according to the accessor sizes
+    boost::fusion::for_each(_accessorListMap.table, [&](auto& pair) {
+      using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+      auto& bufferList = boost::fusion::at_key<UserType>(_snapshot.buffers.table);
+      auto& versionList = boost::fusion::at_key<UserType>(_snapshot.versions.table);
+      for(auto& accessor : pair.second) {
+        bufferList.emplace_back(accessor.getNElements());
+        versionList.emplace_back(nullptr);
+      }
+    });
+
+    // start the writer thread, it is joined when leaving this function (i.e. when the module is terminated)
+    std::unique_ptr<detail::DAQWriter<TRIGGERTYPE>> writer;
+    if(_writerQueueLength > 0) {
+      std::cout << "Starting DAQ writer thread with a queue length of " << _writerQueueLength << "." << std::endl;
+      writer = std::make_unique<detail::DAQWriter<TRIGGERTYPE>>(storage, _writerQueueLength, _snapshot);
+      _writer = writer.get();
+      _nQueuedFiles = 0;
+    }
+
+    // file size used for maxFileSize
+    _bytesPerTrigger = estimateBytesPerTrigger();
+    status.estimatedBytesPerTrigger = _bytesPerTrigger;
+    status.estimatedBytesPerTrigger.write();
+    status.nRecordedVariables = _overallVariableList.size();
+    status.nRecordedVariables.write();
+
+    // start the retention thread, it is stopped when leaving this function like the writer thread
+    auto retention = std::make_unique<detail::DiskRetention>();
+    _retention = retention.get();
+
+    // allocate the pre-trigger ring, the initial value of the event variable does not start a capture
+    if(_eventCapture) {
+      _captureRing.assign(_nPreTrigger, _snapshot);
+      _lastEventVersion = captureEvent.getVersionNumber();
+    }
+
+    // write initial values
+    processTrigger();
+
+    // report the startup phases, which can take long for large models
+    auto ms = [](std::chrono::steady_clock::duration d) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+    std::cout << "MicroDAQ: Started with " << _overallVariableList.size() << " variables. Adding variables took "
+              << ms(_startupTimes.addVariables) << " ms, compiling the write plan " << ms(_startupTimes.writePlan)
+              << " ms, writing the initial values " << ms(std::chrono::steady_clock::now() - start) << " ms."
+              << std::endl;
+
+    // loop: process incoming triggers
+    auto group = readAnyGroup();
+    while(true) {
+      // Wait for the DAQ trigger and an update of all accessors using the DAQ trigger as external node
+      group.readUntilAll(accessorsWithTrigger);
+      processTrigger();
+      updateDiagnostics();
+    }
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::processTrigger() {
+    // set new daqPath if DAQ is disabled
+    updateDAQPath();
+
+    // errors of the writer thread are detected with the next trigger
+    bool writerFailed = false;
+    if(_writer) {
+      writerFailed = _writer->openFailed.exchange(false);
+      writerFailed = _writer->writeFailed.exchange(false) || writerFailed;
+      if(writerFailed) _isOpened = false;
+    }
+
+    if(_eventCapture) {
+      captureTrigger(writerFailed);
+    }
+    // need to open or close file?
+    else if(!_isOpened && enable != 0 && status.errorStatus == 0 && !writerFailed) {
+      // some things to be done only on first trigger
+      if(_firstTrigger) {
+        checkBufferOnFirstTrigger();
+        _firstTrigger = false;
+      }
+      _isOpened = requestOpen((_daqPath / nextBuffer()).string());
+      _fileStartTime = trigger.getVersionNumber().getTime();
+    }
+    else if(_isOpened && enable == 0) {
+      requestClose();
+      _isOpened = false;
+      disableDAQ();
+    }
+
+    // if file is opened, this trigger should be included in the DAQ
+    if(!_eventCapture && _isOpened && requestWrite()) {
+      status.currentEntry = status.currentEntry + 1;
+      status.currentEntry.write();
+    }
+
+    // update error status for active DAQ (done by captureTrigger() in event capture mode)
+    if(enable == 1 && !_eventCapture) {
+      // only write error message once
+      if(!_isOpened && status.errorStatus == 0) {
+        std::cerr
+            << "Something went wrong. File could not be opened. Solve the problem and toggle enable DAQ to try again."
+            << std::endl;
+        status.errorStatus = 1;
+        status.errorStatus.write();
+      }
+      else if(_isOpened && status.errorStatus != 0) {
+        status.errorStatus = 0;
+        status.errorStatus.write();
+      }
+    }
+
+    // close file if all triggers are filled, will re-open on next trigger
+    if(!_eventCapture && _isOpened && maxEntriesReached()) {
+      requestClose();
+      _isOpened = false;
+    }
+
+    // hand the requests of this trigger over to the writer thread
+    submitCommand();
+
+    _storage->updateStatus();
+    updateRetentionStatus();
+    if(_writer) {
+      status.writerQueueDepth = _writer->depth();
+      status.writerQueueDepth.write();
+      if(status.writerQueueHighWaterMark != _writer->highWaterMark()) {
+        status.writerQueueHighWaterMark = _writer->highWaterMark();
+        status.writerQueueHighWaterMark.write();
+      }
+    }
+
+    ++_triggerNumber;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::captureTrigger(bool writerFailed) {
+    bool event = captureEvent.getVersionNumber() != _lastEventVersion && captureEvent != 0;
+    _lastEventVersion = captureEvent.getVersionNumber();
+
+    if(enable == 0) {
+      if(_isOpened) {
+        requestClose();
+        _isOpened = false;
+        disableDAQ();
+      }
+      else if(status.errorStatus != 0) {
+        status.errorStatus = 0;
+        status.errorStatus.write();
+      }
+      // values kept while disabled are outdated once the DAQ is enabled again
+      _captureCount = 0;
+      return;
+    }
+    if(status.errorStatus != 0) return;
+
+    if(_isOpened && !writerFailed) {
+      // post-trigger phase
+      if(requestWrite()) {
+        status.currentEntry = status.currentEntry + 1;
+        status.currentEntry.write();
+      }
+      _nPostTriggerRemaining = event ? _nPostTrigger : _nPostTriggerRemaining - 1;
+    }
+    else if(event && !writerFailed) {
+      if(_firstTrigger) {
+        checkBufferOnFirstTrigger();
+        _firstTrigger = false;
+      }
+      _isOpened = requestOpen((_daqPath / nextBuffer()).string());
+      submitCommand();
+
+      // pre-trigger values, oldest first
+      for(size_t i = _captureCount; i > 0 && _isOpened; --i) {
+        requestWrite(_captureRing[(_captureNext + _captureRing.size() - i) % _captureRing.size()]);
+        status.currentEntry = status.currentEntry + 1;
+      }
+      _captureCount = 0;
+
+      // event trigger, not dropped even if the pre-trigger values have filled the queue
+      if(_isOpened && requestWrite(true)) status.currentEntry = status.currentEntry + 1;
+      status.currentEntry.write();
+      _nPostTriggerRemaining = _nPostTrigger;
+    }
+    else if(!writerFailed) {
+      // keep the values for the next event
+      if(!_captureRing.empty()) {
+        copyToSnapshot(_captureRing[_captureNext]);
+        _captureNext = (_captureNext + 1) % _captureRing.size();
+        _captureCount = std::min(_captureCount + 1, _captureRing.size());
+      }
+      return;
+    }
+
+    if(!_isOpened) {
+      std::cerr << "Something went wrong. Event could not be written. Solve the problem and toggle enable DAQ to try "
+                   "again."
+                << std::endl;
+      status.errorStatus = 1;
+      status.errorStatus.write();
+      _nPostTriggerRemaining = 0;
+      return;
+    }
+
+    // the event is complete
+    if(_nPostTriggerRemaining == 0) {
+      requestClose();
+      _isOpened = false;
+      finishBuffer();
+      status.nCapturedEvents = status.nCapturedEvents + 1;
+      status.nCapturedEvents.write();
+    }
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  detail::DAQCommand<TRIGGERTYPE>* BaseDAQ<TRIGGERTYPE>::claimCommand(bool wait) {
+    if(!_command) _command = _writer->claim(wait);
+    return _command;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::submitCommand() {
+    if(_command) {
+      _writer->submit();
+      _command = nullptr;
+    }
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  bool BaseDAQ<TRIGGERTYPE>::requestOpen(const std::string& fileName) {
+    auto settings = _storage->getFileSettings();
+    if(settings) updateRecordedMask(*settings);
+    if(!_writer) {
+      return _storage->open(fileName, settings.get());
+    }
+
+    // failures of the writer thread are reported with the next trigger
+    auto* command = claimCommand(true);
+    command->fileName = fileName;
+    command->settings = std::move(settings);
+    return true;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::updateRecordedMask(detail::FileSettings& settings) {
+    std::pair<std::string, std::string> patterns{includeVariables, excludeVariables};
+    if(_maskPatterns != patterns) {
+      _maskPatterns = patterns;
+
+      // patterns are separated by white space
+      auto split = [](const std::string& list) {
+        std::vector<std::string> result;
+        std::istringstream stream(list);
+        for(std::string pattern; stream >> pattern;) result.push_back(pattern);
+        return result;
+      };
+      auto includes = split(patterns.first);
+      auto excludes = split(patterns.second);
+      auto matchesAny = [](const std::vector<std::string>& patternList, const std::string& name) {
+        return std::any_of(patternList.begin(), patternList.end(),
+            [&](const std::string& pattern) { return fnmatch(pattern.c_str(), name.c_str(), 0) == 0; });
+      };
+
+      uint32_t nRecorded = 0;
+      boost::fusion::for_each(_nameListMap.table, [&](auto& pair) {
+        using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+        auto& mask = boost::fusion::at_key<UserType>(_recordedMask.table);
+        mask.clear();
+        for(auto& name : pair.second) {
+          bool recorded = (includes.empty() || matchesAny(includes, name)) && !matchesAny(excludes, name);
+          mask.push_back(recorded);
+          nRecorded += recorded;
+        }
+      });
+      status.nRecordedVariables = nRecorded;
+      status.nRecordedVariables.write();
+    }
+    settings.recorded = _recordedMask;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  bool BaseDAQ<TRIGGERTYPE>::requestWrite(bool wait) {
+    if(!_writer) {
+      // pass the accessor buffers to the storage without copying by swapping them into the snapshot and back
+      auto swapBuffers = [&](auto& pair) {
+        using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+        auto buffer = boost::fusion::at_key<UserType>(_snapshot.buffers.table).begin();
+        for(auto& accessor : pair.second) {
+          accessor.swap(*buffer);
+          ++buffer;
+        }
+      };
+      fillSnapshotInfo(_snapshot);
+      boost::fusion::for_each(_accessorListMap.table, swapBuffers);
+      _isOpened = _storage->write(_snapshot);
+      boost::fusion::for_each(_accessorListMap.table, swapBuffers);
+      return _isOpened;
+    }
+
+    // values are dropped if the queue is full, unless waiting is requested
+    auto* command = claimCommand(wait);
+    if(!command) {
+      status.nDroppedTriggers = status.nDroppedTriggers + 1;
+      status.nDroppedTriggers.write();
+      return false;
+    }
+    copyToSnapshot(command->snapshot);
+    command->write = true;
+    return true;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::requestWrite(detail::DAQSnapshot<TRIGGERTYPE>& snapshot) {
+    if(!_writer) {
+      _isOpened = _storage->write(snapshot);
+      return;
+    }
+
+    // one queue entry per snapshot, the snapshot is exchanged with the buffers of the queue entry instead of copied
+    submitCommand();
+    auto* command = claimCommand(true);
+    std::swap(command->snapshot, snapshot);
+    command->write = true;
+    submitCommand();
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::requestClose() {
+    if(!_writer) {
+      _storage->close();
+      return;
+    }
+    claimCommand(true)->close = true;
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::fillSnapshotInfo(detail::DAQSnapshot<TRIGGERTYPE>& snapshot) {
+    snapshot.version = trigger.getVersionNumber();
+    snapshot.triggerNumber = _triggerNumber;
+    if constexpr(std::is_integral_v<TRIGGERTYPE>) {
+      snapshot.nMissedTriggers = status.nMissedTriggers;
+    }
+    snapshot.triggerPeriod = status.triggerPeriod;
+    boost::fusion::for_each(_accessorListMap.table, [&](auto& pair) {
+      using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+      auto version = boost::fusion::at_key<UserType>(snapshot.versions.table).begin();
+      for(auto& accessor : pair.second) {
+        *version = accessor.getVersionNumber();
+        ++version;
+      }
+    });
+  }
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void BaseDAQ<TRIGGERTYPE>::copyToSnapshot(detail::DAQSnapshot<TRIGGERTYPE>& snapshot) {
+    fillSnapshotInfo(snapshot);
+    boost::fusion::for_each(_accessorListMap.table, [&](auto& pair) {
+      using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+      auto buffer = boost::fusion::at_key<UserType>(snapshot.buffers.table).begin();
+      for(auto& accessor : pair.second) {
+        std::copy(accessor.begin(), accessor.end(), buffer->begin());
+        ++buffer;
+      }
+    });
+  }
+
+  /********************************************************************************************************************/
+
   INSTANTIATE_TEMPLATE_FOR_CHIMERATK_USER_TYPES_NO_VOID(MicroDAQ);
   INSTANTIATE_TEMPLATE_FOR_CHIMERATK_USER_TYPES_NO_VOID(BaseDAQ);
 
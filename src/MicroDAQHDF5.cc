@@ -9,47 +9,415 @@
 
 #include "MicroDAQHDF5.h"
 
+#include "ChunkCompressor.h"
+
 #include <H5Cpp.h>
 
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <future>
+#include <set>
+#include <type_traits>
+#include <vector>
 
 namespace ChimeraTK {
   namespace detail {
 
     /******************************************************************************************************************/
 
+    /**
+     * HDF5 data type used to store the given UserType. Boolean is stored as 8 bit unsigned integer, std::string as
+     * variable-length string.
+     */
+    template<typename UserType>
+    H5::DataType h5Type();
+
+    template<>
+    H5::DataType h5Type<int8_t>() {
+      return H5::PredType::NATIVE_INT8;
+    }
+    template<>
+    H5::DataType h5Type<uint8_t>() {
+      return H5::PredType::NATIVE_UINT8;
+    }
+    template<>
+    H5::DataType h5Type<int16_t>() {
+      return H5::PredType::NATIVE_INT16;
+    }
+    template<>
+    H5::DataType h5Type<uint16_t>() {
+      return H5::PredType::NATIVE_UINT16;
+    }
+    template<>
+    H5::DataType h5Type<int32_t>() {
+      return H5::PredType::NATIVE_INT32;
+    }
+    template<>
+    H5::DataType h5Type<uint32_t>() {
+      return H5::PredType::NATIVE_UINT32;
+    }
+    template<>
+    H5::DataType h5Type<int64_t>() {
+      return H5::PredType::NATIVE_INT64;
+    }
+    template<>
+    H5::DataType h5Type<uint64_t>() {
+      return H5::PredType::NATIVE_UINT64;
+    }
+    template<>
+    H5::DataType h5Type<float>() {
+      return H5::PredType::NATIVE_FLOAT;
+    }
+    template<>
+    H5::DataType h5Type<double>() {
+      return H5::PredType::NATIVE_DOUBLE;
+    }
+    template<>
+    H5::DataType h5Type<Boolean>() {
+      // Boolean is written directly from the accessor buffer
+      static_assert(sizeof(Boolean) == sizeof(uint8_t), "Boolean cannot be mapped to an 8 bit HDF5 type.");
+      return H5::PredType::NATIVE_UINT8;
+    }
+    template<>
+    H5::DataType h5Type<std::string>() {
+      return H5::StrType(H5::PredType::C_S1, H5T_VARIABLE);
+    }
+
+    /******************************************************************************************************************/
+
+    /**
+     * Settings of the HDF5DAQ control variables applied to a single file.
+     */
+    struct H5FileSettings : FileSettings {
+      bool appendMode{false};
+      bool convertToFloat{false};
+      std::string compressionAlgorithm;
+      uint32_t compressionLevel{0};
+      bool shuffle{false};
+      uint32_t nTriggersPerFile{0};
+      uint32_t flushAfterNEntries{0};
+      bool swmrMode{false};
+      uint32_t swmrFlushPeriod{0};
+      uint32_t compressionThreads{0};
+      bool timeAttribute{false};
+      bool changeOnlyScalars{false};
+      bool compoundScalars{false};
+    };
+
+    /******************************************************************************************************************/
+
     template<typename TRIGGERTYPE>
-    struct H5storage {
+    struct H5storage : DAQStorage<TRIGGERTYPE> {
       H5storage(HDF5DAQ<TRIGGERTYPE>* owner) : _owner(owner) {
         // prepare internal data
         hsize_t dimsf[1] = {1}; // dataset dimensions
-        _space["MicroDAQ.nMissedTriggers"] = H5::DataSpace(1, dimsf);
-        _space["MicroDAQ.triggerPeriod"] = H5::DataSpace(1, dimsf);
+        _singleValueSpace = H5::DataSpace(1, dimsf);
       }
+      ~H5storage() override { close(); }
 
       std::unique_ptr<H5::H5File> outFile{};
-      std::string currentGroupName;
 
-      /** Unique list of groups, used to create the groups in the file */
-      std::list<std::string> groupList;
+      /** Group of the current trigger (not used in append mode) */
+      H5::Group triggerGroup;
+
+      /** Groups relative to the root group, used to create the groups in the file. Sorted, so lower levels come
+       * first. */
+      std::set<std::string> groupList;
+
+      /** File layout of the currently opened file, taken from HDF5DAQ::appendMode when opening the file */
+      bool appendMode{false};
+
+      /** Legacy data format of the currently opened file, taken from HDF5DAQ::convertToFloat when opening the file */
+      bool convertToFloat{false};
+
+      /** Number of triggers per file when the currently opened file was requested, used to limit the chunk size */
+      uint32_t nTriggersPerFile{0};
+
+      /** Filters applied to all data sets of the currently opened file */
+      struct Filters {
+        bool shuffle{false};
+        H5Z_filter_t filter{H5Z_FILTER_NONE};
+        unsigned int level{0};
+
+        bool enabled() const { return shuffle || filter != H5Z_FILTER_NONE; }
+      } filters;
+
+      /** Uncompressed size of all data written to the currently opened file, used to compute the compression ratio */
+      hsize_t bytesWritten{0};
 
-      /** boost::fusion::map of UserTypes to std::lists containing the H5::DataSpace
-       * objects. */
+      /** Number of triggers written to the current file, i.e. rows of the extendible data sets in append mode and
+       * trigger groups otherwise */
+      hsize_t nRows{0};
+
+      /** Add the time of the trigger as human-readable attribute to each trigger group (not in append mode) */
+      bool timeAttribute{false};
+
+      /** Number of triggers staged in memory before writing them at once, taken from HDF5DAQ::flushAfterNEntries when
+       * opening the file. Values below 2 disable staging. */
+      uint32_t flushAfterNEntries{0};
+
+      /** Number of triggers currently staged in memory */
+      hsize_t nStaged{0};
+
+      /** Single-writer/multiple-reader access of the currently opened file (append mode only) */
+      bool swmrMode{false};
+
+      /** Number of rows after which the file is flushed in SWMR mode, taken from HDF5DAQ::swmrFlushPeriod */
+      uint32_t swmrFlushPeriod{0};
+
+      /** Number of rows of the current file already flushed for SWMR readers */
+      hsize_t nRowsFlushed{0};
+
+      /** Chunks of the current file are compressed by the ChunkCompressor and written directly (append mode only) */
+      bool directChunkWrite{false};
+
+      /** Chunk of an extendible data set assembled in memory before it is compressed (direct chunk write only) */
+      struct ChunkBuffer {
+        std::vector<char> data; ///< Raw data of all rows of the chunk in the file data type
+        hsize_t nRows{0};       ///< Number of rows of a chunk
+        size_t typeSize{0};     ///< Size of a single element in the file
+        hsize_t nFilled{0};     ///< Number of rows already filled
+        hsize_t index{0};       ///< Index of the chunk in the data set
+      };
+
+      /** Scalars are only stored for triggers at which they were updated (append mode only) */
+      bool changeOnlyScalars{false};
+
+      /** Scalar stored only when updated: the values are written to the data set of the variable, the rows of the
+       * corresponding triggers to rowDataSet. */
       template<typename UserType>
-      using dataSpaceList = std::list<H5::DataSpace>;
-      TemplateUserTypeMap<dataSpaceList> dataSpaceListMap;
+      struct SparseColumn {
+        bool enabled{false};                ///< Variable is a scalar and changeOnlyScalars is set
+        H5::DataSet rowDataSet;             ///< Rows of MicroDAQ/triggerNumber at which the values were recorded
+        VersionNumber lastVersion{nullptr}; ///< Version of the last recorded value
+        hsize_t nWritten{0};                ///< Number of values already written to the file
+        std::vector<UserType> values;       ///< Recorded values not yet written
+        std::vector<uint64_t> rows;         ///< Rows of the values not yet written
+      };
+
+      /**
+       * Entry of the write plan: everything needed to write a single variable, compiled when the DAQ is started. The
+       * file specific members are reset when a file is opened.
+       */
+      template<typename UserType>
+      struct Column {
+        Column(const DecimationSettings& settings, size_t nInputElements) : decimator(settings, nInputElements) {}
+
+        Decimator<UserType> decimator;
+        std::string name;              ///< Path of the data set relative to the root group (or the trigger group)
+        hsize_t nElements{0};          ///< Number of elements of a row after decimation
+        H5::DataSpace dataSpace;       ///< Data space of a single row
+        H5::DataSet dataSet;           ///< Extendible data set of the current file (append mode only)
+        ChunkBuffer chunk;             ///< Chunk buffer (direct chunk write only, not used for std::string)
+        SparseColumn<UserType> sparse; ///< Sparse storage, disabled for variables stored densely
+        std::vector<UserType> staging; ///< flushAfterNEntries rows of decimated data (append mode only)
+        bool inRecord{false};          ///< Scalar is a member of the compound record (see Record)
+        size_t recordOffset{0};        ///< Offset of the scalar in the compound record
+        bool recorded{true};           ///< Variable is recorded in the current file (see FileSettings::recorded)
+        size_t rateGroup{0};           ///< Rate group of the variable, 0 if recorded on each trigger
+      };
+
+      /** Scalars are packed into one compound record per trigger (append mode only) */
+      bool compoundScalars{false};
+
+      /**
+       * Compound record containing all recorded scalars except strings, appended to the data set MicroDAQ/scalars
+       * once per trigger instead of writing one data set per scalar. The layout is computed when the DAQ is started
+       * and again when the recorded variables change.
+       */
+      struct Record {
+        size_t size{0};         ///< Size of a record in bytes, 0 if there is no scalar to pack
+        H5::CompType type;      ///< Packed compound type, members ordered by decreasing size
+        H5::DataSet dataSet;    ///< Extendible data set of the current file
+        std::vector<char> rows; ///< Record of the current trigger, or flushAfterNEntries records if staging
+        ChunkBuffer chunk;      ///< Chunk buffer (direct chunk write only)
+      } record;
+
+      /** boost::fusion::map of UserTypes to vectors containing the write plan, in the same order as the buffers of the
+       * snapshot. */
+      template<typename UserType>
+      using columnList = std::vector<Column<UserType>>;
+      TemplateUserTypeMapNoVoid<columnList> columnListMap;
+
+      std::shared_ptr<FileSettings> getFileSettings() override;
+      bool open(const std::string& fileName, const FileSettings* settings) override;
+      bool write(const DAQSnapshot<TRIGGERTYPE>& snapshot) override;
+
+      /**
+       * Update the compression ratio and close the file.
+       */
+      void close() override;
+
+      /**
+       * Publish the compression ratio of the last closed file.
+       */
+      void updateStatus() override;
+
+      void writeData(const DAQSnapshot<TRIGGERTYPE>& snapshot);
 
-      /** boost::fusion::map of UserTypes to std::lists containing decimation
-       * factors. */
+      /**
+       * Local time with millisecond resolution, e.g. 2020-05-12 13:46:59.777
+       */
+      static std::string formatTime(const std::chrono::system_clock::time_point& time);
+
+      /**
+       * Set filters from the file settings. Unavailable filter plugins are replaced by deflate.
+       */
+      void setFilters(const H5FileSettings& settings);
+
+      /**
+       * Add the configured filters to the data set creation properties. Chunking must be enabled already.
+       */
+      void applyFilters(H5::DSetCreatPropList& properties) const;
+
+      /**
+       * Assign the offsets of all recorded scalars in the compound record and create its HDF5 type. Members are ordered
+       * by decreasing size, so each member is naturally aligned in the packed record.
+       */
+      void createRecordLayout();
+
+      /**
+       * Append the record of the current trigger to the record data set (or the chunk buffer).
+       */
+      void appendRecord();
+
+      /**
+       * Create groups and extendible data sets for all variables in the newly opened file (append mode only).
+       */
+      void createDataSets();
+
+      /**
+       * Append one row to all data sets of the current file (append mode only). If staging is enabled, the row is
+       * copied to the staging buffers and written by flushStaged() once flushAfterNEntries rows are staged. Variables
+       * of rate groups are only written if the group is due and are never staged.
+       */
+      void appendData(const DAQSnapshot<TRIGGERTYPE>& snapshot);
+
+      /**
+       * Append the trigger number and time stamp to the trigger index of all rate groups due with the trigger (append
+       * mode only).
+       */
+      void appendRateGroupIndex(uint64_t triggerNumber, int64_t timeStamp);
+
+      /** Whether the variables of the rate group are written with the given trigger, see BaseDAQ::addRateGroup() */
+      bool isDue(size_t rateGroup, uint64_t triggerNumber) const {
+        return _owner->isRateGroupDue(rateGroup, triggerNumber);
+      }
+
+      /** Row of the next trigger written to the data sets of the given rate group (append mode only) */
+      hsize_t rateGroupRow(size_t rateGroup) const {
+        return rateGroup == 0 ? nRows : _rateGroupIndex[rateGroup - 1].nRows;
+      }
+
+      /**
+       * Write all staged rows to the data sets of the current file with a single write per data set.
+       */
+      void flushStaged();
+
+      /**
+       * Flush the file in SWMR mode, if swmrFlushPeriod rows have been written since the last flush.
+       */
+      void flushForReaders();
+
+      /**
+       * Record the value of a scalar for the given row, if it was updated since the value recorded last. Returns
+       * true if the value was recorded.
+       */
+      template<typename UserType>
+      bool recordIfChanged(
+          SparseColumn<UserType>& column, const DecimatedData<UserType>& data, const VersionNumber& version, hsize_t row);
+
+      /**
+       * Write the recorded values and rows of the sparse column to the file.
+       */
+      template<typename UserType>
+      void flushSparse(SparseColumn<UserType>& column, H5::DataSet& dataSet);
+
+      /**
+       * Copy the (decimated) data as next row into the chunk buffer. A full chunk is passed to the ChunkCompressor.
+       */
+      template<typename UserType>
+      void appendToChunk(ChunkBuffer& chunk, H5::DataSet& dataSet, const DecimatedData<UserType>& data);
+
+      /**
+       * Pass the filled rows of the chunk to the ChunkCompressor.
+       */
+      void submitChunk(ChunkBuffer& chunk, H5::DataSet& dataSet);
+
+      /**
+       * Write compressed chunks to the file in the order they were submitted. If wait is false, only chunks already
+       * compressed are written.
+       */
+      void writeCompressedChunks(bool wait);
+
+      /**
+       * Submit all partially filled chunks and write all chunks to the file.
+       */
+      void flushChunks();
+
+      /**
+       * Write the (decimated) data to the selection of the file space. Data is written directly from the buffer
+       * unless the legacy float format is used or the data is of type std::string.
+       */
       template<typename UserType>
-      using decimationFactorList = std::list<size_t>;
-      TemplateUserTypeMap<decimationFactorList> decimationFactorListMap;
+      void writeSelection(const UserType* buffer, hsize_t nElements, size_t decimationFactor, H5::DataSet& dataSet,
+          const H5::DataSpace& fileSpace);
 
-      bool isOpened{false};
-      bool firstTrigger{true};
+      /**
+       * Create a chunked data set with unlimited first dimension. Scalars result in a 1D data set, arrays in a 2D data
+       * set with one row per trigger.
+       */
+      H5::DataSet createExtendibleDataSet(const std::string& name, const H5::DataType& type, hsize_t nElements);
+
+      /**
+       * Number of rows of a chunk of an extendible data set.
+       */
+      hsize_t chunkRows(hsize_t nElements, size_t typeSize) const;
 
-      void processTrigger();
-      void writeData();
+      /**
+       * Extend the given data set by nNewRows rows and return the file space with the new rows selected.
+       */
+      H5::DataSpace appendRows(H5::DataSet& dataSet, hsize_t nElements, hsize_t nNewRows) {
+        return extendRows(dataSet, nRows, nElements, nNewRows);
+      }
+
+      /**
+       * Extend the given data set with firstRow rows by nNewRows rows and return the file space with the new rows
+       * selected. Used for data sets not containing one row per trigger.
+       */
+      H5::DataSpace extendRows(H5::DataSet& dataSet, hsize_t firstRow, hsize_t nElements, hsize_t nNewRows);
+
+      /**
+       * Extend the given data set by one row and return the file space with the new row selected.
+       */
+      H5::DataSpace appendRow(H5::DataSet& dataSet, hsize_t nElements) { return appendRows(dataSet, nElements, 1); }
+
+      /**
+       * Extend the given data set by one row and write the buffer to the new row.
+       */
+      void appendRow(H5::DataSet& dataSet, const void* buffer, const H5::DataType& type, hsize_t nElements) {
+        extendRow(dataSet, nRows, buffer, type, nElements);
+      }
+
+      /**
+       * Extend the given data set with firstRow rows by one row and write the buffer to the new row. Used for data sets
+       * not containing one row per trigger.
+       */
+      void extendRow(
+          H5::DataSet& dataSet, hsize_t firstRow, const void* buffer, const H5::DataType& type, hsize_t nElements);
+
+      /**
+       * HDF5 data type used in the file for the given UserType, depending on convertToFloat.
+       */
+      template<typename UserType>
+      H5::DataType fileType() const {
+        return convertToFloat ? H5::DataType(H5::PredType::NATIVE_FLOAT) : h5Type<UserType>();
+      }
 
       HDF5DAQ<TRIGGERTYPE>* _owner;
 
@@ -61,8 +429,60 @@ namespace ChimeraTK {
       std::vector<TransferElementID> _accessorsWithTrigger;
 
      private:
-      std::vector<float> _buffer{1};
-      std::map<std::string, H5::DataSpace> _space;
+      /** Data space of a single value of the internal data (not used in append mode) */
+      H5::DataSpace _singleValueSpace;
+
+      /** HDF5 data type used in the file for the internal data */
+      H5::DataType internalType() const {
+        return convertToFloat ? H5::PredType::NATIVE_FLOAT : H5::PredType::NATIVE_INT64;
+      }
+
+      /** Write values of the internal data to the selection of the file space */
+      void writeInternal(H5::DataSet& dataSet, const H5::DataSpace& fileSpace, const int64_t* values, hsize_t n);
+
+      /** Write a single value of the internal data to the selection of the file space */
+      void writeInternal(H5::DataSet& dataSet, const H5::DataSpace& fileSpace, int64_t value) {
+        writeInternal(dataSet, fileSpace, &value, 1);
+      }
+
+      /** Extendible data sets for the internal data (append mode only) */
+      struct InternalDataSets {
+        H5::DataSet triggerNumber, timeStamp, nMissedTriggers, triggerPeriod;
+      } _internal;
+
+      /** Trigger index of each rate group in MicroDAQ/rateGroups/<name>, in the order of the groups (append mode) */
+      struct RateGroupIndex {
+        H5::DataSet triggerNumber, timeStamp;
+        hsize_t nRows{0}; ///< Number of triggers of the group written to the current file
+      };
+      std::vector<RateGroupIndex> _rateGroupIndex;
+
+      /** Staged internal data (append mode only) */
+      std::vector<uint64_t> _stagedTriggerNumber;
+      std::vector<int64_t> _stagedTimeStamp, _stagedMissedTriggers, _stagedTriggerPeriod;
+
+      /** Chunk submitted to the ChunkCompressor, waiting to be written to the file */
+      struct PendingChunk {
+        H5::DataSet dataSet;
+        hsize_t offset;
+        hsize_t nRows;
+        std::future<std::vector<char>> data;
+      };
+      std::deque<PendingChunk> _pendingChunks;
+
+      /** Thread pool compressing chunks in direct chunk write mode, kept while the number of threads is unchanged */
+      std::unique_ptr<ChunkCompressor> _compressor;
+
+      /** Compression ratio of the last closed file, handed over to the DAQ thread by updateStatus() */
+      std::atomic<float> _compressionRatio{0};
+      std::atomic<bool> _compressionRatioChanged{false};
+
+      /** Target size of a single chunk in bytes. The chunk is never larger than the number of triggers per file. */
+      static constexpr hsize_t _chunkSize{64 * 1024};
+
+      /** Filter IDs of the LZF and Zstandard filter plugins as registered with the HDF Group */
+      static constexpr H5Z_filter_t _filterLZF{32000};
+      static constexpr H5Z_filter_t _filterZstd{32015};
     };
 
     /******************************************************************************************************************/
@@ -77,34 +497,35 @@ namespace ChimeraTK {
 
         // get the lists for the UserType
         auto& accessorList = pair.second;
-        auto& decimationFactorList = boost::fusion::at_key<UserType>(_storage.decimationFactorListMap.table);
-        auto& dataSpaceList = boost::fusion::at_key<UserType>(_storage.dataSpaceListMap.table);
+        auto& columnList = boost::fusion::at_key<UserType>(_storage.columnListMap.table);
         auto& nameList = boost::fusion::at_key<UserType>(_storage._owner->_nameListMap.table);
+        auto& decimationList = boost::fusion::at_key<UserType>(_storage._owner->_decimationListMap.table);
+        auto& rateGroupList = boost::fusion::at_key<UserType>(_storage._owner->_rateGroupListMap.table);
 
         // iterate through all accessors for this UserType
+        columnList.reserve(accessorList.size());
         auto name = nameList.begin();
-        for(auto accessor = accessorList.begin(); accessor != accessorList.end(); ++accessor, ++name) {
+        auto decimation = decimationList.begin();
+        auto rateGroup = rateGroupList.begin();
+        for(auto accessor = accessorList.begin(); accessor != accessorList.end();
+            ++accessor, ++name, ++decimation, ++rateGroup) {
           // check if accessor uses DAQ trigger as external trigger
           if(_storage._owner->isAccessorUsingDAQTrigger(*accessor)) {
             _storage._accessorsWithTrigger.push_back(accessor->getId());
           }
-          // determine decimation factor
-          int factor = 1;
-          if(accessor->getNElements() > _storage._owner->_decimationThreshold) {
-            factor = _storage._owner->_decimationFactor;
-          }
-          decimationFactorList.push_back(factor);
 
-          // define data space
-          hsize_t dimsf[1]; // dataset dimensions
-          dimsf[0] = accessor->getNElements() / factor;
-          dataSpaceList.push_back(H5::DataSpace(1, dimsf));
+          // determine decimation and define data space
+          auto& column = columnList.emplace_back(*decimation, accessor->getNElements());
+          column.name = name->substr(1);
+          column.rateGroup = *rateGroup;
+          column.nElements = column.decimator.nDecimated;
+          assert(column.nElements > 0); // ensured by BaseDAQ::resolveDecimation()
+          column.dataSpace = H5::DataSpace(1, &column.nElements);
 
           // put all group names in list (each hierarchy level separately)
           size_t idx = 0;
           while((idx = name->find('/', idx + 1)) != std::string::npos) {
-            std::string groupName = name->substr(0, idx);
-            _storage.groupList.push_back(groupName);
+            _storage.groupList.insert(name->substr(1, idx - 1));
           }
         }
       }
@@ -112,6 +533,116 @@ namespace ChimeraTK {
       H5storage<TRIGGERTYPE>& _storage;
     };
 
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    struct H5DataSetCreator {
+      H5DataSetCreator(H5storage<TRIGGERTYPE>& storage) : _storage(storage) {}
+
+      template<typename PAIR>
+      void operator()(PAIR& pair) const {
+        typedef typename PAIR::first_type UserType;
+
+        // create one extendible data set per variable, the length of a row is given by the decimation
+        for(auto& column : pair.second) {
+          // scalars packed into the compound record and variables not recorded have no data set of their own
+          if(!column.recorded || (_storage.compoundScalars && column.inRecord)) {
+            column.sparse = {};
+            column.staging.clear();
+            column.chunk = {};
+            continue;
+          }
+
+          auto type = _storage.template fileType<UserType>();
+          column.dataSet = _storage.createExtendibleDataSet(column.name, type, column.nElements);
+
+          // sparse columns are staged and written separately, rate groups are written directly when due
+          auto& sparse = column.sparse;
+          sparse = {};
+          sparse.enabled = _storage.changeOnlyScalars && column.nElements == 1 && column.rateGroup == 0;
+          if(sparse.enabled) {
+            sparse.rowDataSet = _storage.createExtendibleDataSet(column.name + "_row", H5::PredType::NATIVE_UINT64, 1);
+          }
+          bool staged = _storage.flushAfterNEntries > 1 && !sparse.enabled && column.rateGroup == 0;
+          column.staging.assign(staged ? _storage.flushAfterNEntries * column.nElements : 0, UserType());
+
+          // variable-length strings cannot be compressed outside of the HDF5 library
+          column.chunk = {};
+          if(_storage.directChunkWrite && !std::is_same<UserType, std::string>::value && !sparse.enabled) {
+            auto& chunk = column.chunk;
+            chunk.typeSize = type.getSize();
+            chunk.nRows = _storage.chunkRows(column.nElements, chunk.typeSize);
+            chunk.data.resize(chunk.nRows * column.nElements * chunk.typeSize);
+          }
+        }
+      }
+
+      H5storage<TRIGGERTYPE>& _storage;
+    };
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    struct H5DataStager {
+      H5DataStager(H5storage<TRIGGERTYPE>& storage, const DAQSnapshot<TRIGGERTYPE>& snapshot)
+      : _storage(storage), _snapshot(snapshot) {}
+
+      template<typename PAIR>
+      void operator()(PAIR& pair) const {
+        typedef typename PAIR::first_type UserType;
+
+        // get the lists for the UserType
+        auto& bufferList = pair.second;
+        auto& versionList = boost::fusion::at_key<UserType>(_snapshot.versions.table);
+        auto& columnList = boost::fusion::at_key<UserType>(_storage.columnListMap.table);
+
+        // copy the decimated data into the next free row of the staging buffers
+        for(size_t i = 0; i < columnList.size(); ++i) {
+          auto& column = columnList[i];
+          if(!column.recorded || column.rateGroup != 0) continue;
+          auto decimated = column.decimator(bufferList[i]);
+          if(_storage.compoundScalars && column.inRecord) {
+            auto* record = _storage.record.rows.data() + _storage.nStaged * _storage.record.size;
+            std::memcpy(record + column.recordOffset, decimated.data, sizeof(UserType));
+            continue;
+          }
+          if(column.sparse.enabled) {
+            _storage.recordIfChanged(column.sparse, decimated, versionList[i], _storage.nRows + _storage.nStaged);
+            continue;
+          }
+          auto row = column.staging.begin() + _storage.nStaged * column.nElements;
+          for(size_t k = 0; k < column.nElements; ++k) row[k] = decimated.data[k * decimated.stride];
+        }
+      }
+
+      H5storage<TRIGGERTYPE>& _storage;
+      const DAQSnapshot<TRIGGERTYPE>& _snapshot;
+    };
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    struct H5StagedDataWriter {
+      H5StagedDataWriter(H5storage<TRIGGERTYPE>& storage, hsize_t nNewRows) : _storage(storage), _nNewRows(nNewRows) {}
+
+      template<typename PAIR>
+      void operator()(PAIR& pair) const {
+        // append all staged rows of each variable with a single write
+        for(auto& column : pair.second) {
+          if(!column.recorded || column.rateGroup != 0 || (_storage.compoundScalars && column.inRecord)) continue;
+          if(column.sparse.enabled) {
+            _storage.flushSparse(column.sparse, column.dataSet);
+            continue;
+          }
+          auto fileSpace = _storage.appendRows(column.dataSet, column.nElements, _nNewRows);
+          _storage.writeSelection(column.staging.data(), column.nElements * _nNewRows, 1, column.dataSet, fileSpace);
+        }
+      }
+
+      H5storage<TRIGGERTYPE>& _storage;
+      hsize_t _nNewRows;
+    };
+
   } // namespace detail
 
   /********************************************************************************************************************/
@@ -119,6 +650,7 @@ namespace ChimeraTK {
   template<typename TRIGGERTYPE>
   void HDF5DAQ<TRIGGERTYPE>::mainLoop() {
     std::cout << "Initialising HDF5DAQ system..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
 
     // storage object
     detail::H5storage<TRIGGERTYPE> storage(this);
@@ -130,21 +662,11 @@ namespace ChimeraTK {
     // add trigger
     storage._accessorsWithTrigger.push_back(BaseDAQ<TRIGGERTYPE>::trigger.getId());
 
-    // sort group list and make unique to make sure lower levels get created first
-    storage.groupList.sort();
-    storage.groupList.unique();
-
-    // write initial values
-    storage.processTrigger();
+    // the record layout is the same for all files
+    storage.createRecordLayout();
 
-    // loop: process incoming triggers
-    auto group = ApplicationModule::readAnyGroup();
-    while(true) {
-      // Wait for the DAQ trigger and an update of all accessors using the DAQ trigger as external node
-      group.readUntilAll(storage._accessorsWithTrigger);
-      storage.processTrigger();
-      BaseDAQ<TRIGGERTYPE>::updateDiagnostics();
-    }
+    BaseDAQ<TRIGGERTYPE>::_startupTimes.writePlan = std::chrono::steady_clock::now() - start;
+    BaseDAQ<TRIGGERTYPE>::runDAQ(storage, storage._accessorsWithTrigger);
   }
 
   /********************************************************************************************************************/
@@ -152,172 +674,794 @@ namespace ChimeraTK {
   namespace detail {
 
     template<typename TRIGGERTYPE>
-    void H5storage<TRIGGERTYPE>::processTrigger() {
-      // set new daqPath if DAQ is disabled
-      _owner->updateDAQPath();
+    std::shared_ptr<FileSettings> H5storage<TRIGGERTYPE>::getFileSettings() {
+      auto settings = std::make_shared<H5FileSettings>();
+      settings->appendMode = (_owner->appendMode != 0);
+      settings->convertToFloat = (_owner->convertToFloat != 0);
+      settings->compressionAlgorithm = (std::string)_owner->compressionAlgorithm;
+      settings->compressionLevel = _owner->compressionLevel;
+      settings->shuffle = (_owner->shuffle != 0);
+      settings->nTriggersPerFile = _owner->nTriggersPerFile;
+      settings->flushAfterNEntries = _owner->flushAfterNEntries;
+      settings->swmrMode = (_owner->swmrMode != 0);
+      settings->swmrFlushPeriod = _owner->swmrFlushPeriod;
+      settings->compressionThreads = _owner->compressionThreads;
+      settings->timeAttribute = (_owner->timeAttribute != 0);
+      settings->changeOnlyScalars = (_owner->changeOnlyScalars != 0);
+      settings->compoundScalars = (_owner->compoundScalars != 0);
+      return settings;
+    }
 
-      // need to open or close file?
-      if(!isOpened && _owner->enable != 0 && _owner->status.errorStatus == 0) {
-        // some things to be done only on first trigger
-        if(firstTrigger) {
-          _owner->checkBufferOnFirstTrigger();
-          firstTrigger = false;
-        }
+    /******************************************************************************************************************/
 
-        std::string filename = _owner->nextBuffer();
+    template<typename TRIGGERTYPE>
+    bool H5storage<TRIGGERTYPE>::open(const std::string& fileName, const FileSettings* settings) {
+      const auto& h5Settings = *static_cast<const H5FileSettings*>(settings);
 
-        // open file
-        try {
-          outFile.reset(new H5::H5File{(_owner->_daqPath / filename).c_str(), H5F_ACC_TRUNC});
-        }
-        catch(H5::FileIException&) {
-          return;
-        }
-        isOpened = true;
+      // SWMR requires all objects to be created before writing, which is only the case in append mode
+      swmrMode = h5Settings.swmrMode;
+      if(swmrMode && !h5Settings.appendMode) {
+        std::cerr << "HDF5DAQ: SWMR mode requires append mode and is ignored." << std::endl;
+        swmrMode = false;
       }
-      else if(isOpened && _owner->enable == 0) {
-        outFile->close();
-        isOpened = false;
-        _owner->disableDAQ();
-      }
-
-      // if file is opened, this trigger should be included in the DAQ
-      if(isOpened) {
-        // write data
-        writeData();
-        _owner->status.currentEntry = _owner->status.currentEntry + 1;
-        _owner->status.currentEntry.write();
-      }
-
-      // update error status for active DAQ
-      if(_owner->enable == 1) {
-        // only write error message once
-        if(!isOpened && _owner->status.errorStatus == 0) {
-          std::cerr
-              << "Something went wrong. File could not be opened. Solve the problem and toggle enable DAQ to try again."
-              << std::endl;
-          _owner->status.errorStatus = 1;
-          _owner->status.errorStatus.write();
+
+      try {
+        // SWMR requires the latest file format
+        H5::FileAccPropList accessProperties;
+        if(swmrMode) accessProperties.setLibverBounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+        outFile.reset(
+            new H5::H5File{fileName.c_str(), H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, accessProperties});
+
+        // the layout, data format and filters are fixed for the lifetime of the file
+        appendMode = h5Settings.appendMode;
+        convertToFloat = h5Settings.convertToFloat;
+        nTriggersPerFile = h5Settings.nTriggersPerFile;
+        flushAfterNEntries = h5Settings.flushAfterNEntries;
+        swmrFlushPeriod = h5Settings.swmrFlushPeriod;
+        timeAttribute = h5Settings.timeAttribute;
+        changeOnlyScalars = appendMode && h5Settings.changeOnlyScalars;
+
+        // the members of the record depend on the recorded variables
+        if(applyRecordedMask(columnListMap, h5Settings)) createRecordLayout();
+
+        // the record is written in the native types, so it cannot be combined with the legacy float format
+        compoundScalars = appendMode && h5Settings.compoundScalars && record.size > 0;
+        if(compoundScalars && (changeOnlyScalars || convertToFloat)) {
+          std::cerr << "HDF5DAQ: Compound scalars cannot be combined with changeOnlyScalars or convertToFloat and are "
+                       "ignored."
+                    << std::endl;
+          compoundScalars = false;
         }
-        else if(isOpened && _owner->status.errorStatus != 0) {
-          _owner->status.errorStatus = 0;
-          _owner->status.errorStatus.write();
+        setFilters(h5Settings);
+        bytesWritten = 0;
+        nRows = 0;
+        for(auto& group : _rateGroupIndex) group.nRows = 0;
+
+        // compress chunks in parallel, only the deflate filter is available outside of the HDF5 library
+        directChunkWrite =
+            appendMode && h5Settings.compressionThreads > 0 && filters.filter == H5Z_FILTER_DEFLATE;
+        if(directChunkWrite) {
+          // chunks are written as a whole, so staging is not needed
+          flushAfterNEntries = 0;
+          if(!_compressor || _compressor->getNThreads() != h5Settings.compressionThreads) {
+            _compressor.reset();
+            _compressor = std::make_unique<ChunkCompressor>(h5Settings.compressionThreads);
+          }
         }
-      }
 
-      if(isOpened) {
-        if(_owner->maxEntriesReached()) {
-          // just close the file here, will re-open on next trigger
-          outFile->close();
-          isOpened = false;
+        if(appendMode) createDataSets();
+
+        // readers can open the file from now on, no further objects may be created
+        if(swmrMode && H5Fstart_swmr_write(outFile->getId()) < 0) {
+          std::cerr << "HDF5DAQ: Failed to start SWMR mode." << std::endl;
+          swmrMode = false;
         }
+        nRowsFlushed = 0;
+      }
+      catch(H5::Exception&) {
+        outFile.reset();
+        return false;
+      }
+      return true;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    bool H5storage<TRIGGERTYPE>::write(const DAQSnapshot<TRIGGERTYPE>& snapshot) {
+      if(appendMode) {
+        appendData(snapshot);
+        if(outFile) flushForReaders();
       }
+      else {
+        writeData(snapshot);
+      }
+      return outFile != nullptr;
     }
 
     /******************************************************************************************************************/
 
     template<typename TRIGGERTYPE>
     struct H5DataWriter {
-      H5DataWriter(detail::H5storage<TRIGGERTYPE>& storage) : _storage(storage) {}
+      /** If rateGroupsOnly is set, only the variables of rate groups are written (used if staging is enabled) */
+      H5DataWriter(detail::H5storage<TRIGGERTYPE>& storage, const DAQSnapshot<TRIGGERTYPE>& snapshot,
+          bool rateGroupsOnly = false)
+      : _storage(storage), _snapshot(snapshot), _rateGroupsOnly(rateGroupsOnly) {}
 
       template<typename PAIR>
       void operator()(PAIR& pair) const {
         typedef typename PAIR::first_type UserType;
 
         // get the lists for the UserType
-        auto& accessorList = pair.second;
-        auto& decimationFactorList = boost::fusion::at_key<UserType>(_storage.decimationFactorListMap.table);
-        auto& dataSpaceList = boost::fusion::at_key<UserType>(_storage.dataSpaceListMap.table);
-        auto& nameList = boost::fusion::at_key<UserType>(_storage._owner->_nameListMap.table);
+        auto& bufferList = pair.second;
+        auto& versionList = boost::fusion::at_key<UserType>(_snapshot.versions.table);
+        auto& columnList = boost::fusion::at_key<UserType>(_storage.columnListMap.table);
 
-        // iterate through all accessors for this UserType
-        auto decimationFactor = decimationFactorList.begin();
-        auto dataSpace = dataSpaceList.begin();
-        auto name = nameList.begin();
-        for(auto accessor = accessorList.begin(); accessor != accessorList.end();
-            ++accessor, ++decimationFactor, ++dataSpace, ++name) {
-          // form full path name of data set
-          std::string dataSetName = _storage.currentGroupName + "/" + *name;
+        // iterate through the write plan for this UserType
+        for(size_t i = 0; i < columnList.size(); ++i) {
+          auto& column = columnList[i];
+          if(!column.recorded || !_storage.isDue(column.rateGroup, _snapshot.triggerNumber)) continue;
+          if(_rateGroupsOnly && column.rateGroup == 0) continue;
+          auto decimated = column.decimator(bufferList[i]);
 
           // write to file (this is mainly a function call to allow template
           // specialisations at this point)
           try {
-            write2hdf<UserType>(*accessor, dataSetName, *decimationFactor, *dataSpace);
+            if(_storage.appendMode) {
+              if(_storage.compoundScalars && column.inRecord) {
+                std::memcpy(_storage.record.rows.data() + column.recordOffset, decimated.data, sizeof(UserType));
+              }
+              else if(column.sparse.enabled) {
+                if(_storage.recordIfChanged(column.sparse, decimated, versionList[i], _storage.nRows)) {
+                  _storage.flushSparse(column.sparse, column.dataSet);
+                }
+              }
+              else if(_storage.directChunkWrite && !std::is_same<UserType, std::string>::value) {
+                _storage.appendToChunk(column.chunk, column.dataSet, decimated);
+              }
+              else {
+                append2hdf<UserType>(decimated, column.dataSet, _storage.rateGroupRow(column.rateGroup));
+              }
+            }
+            else {
+              write2hdf<UserType>(decimated, column);
+            }
           }
-          catch(H5::FileIException&) {
-            std::cout << "HDF5DAQ: ERROR writing data set " << dataSetName << std::endl;
+          catch(H5::Exception&) {
+            std::cout << "HDF5DAQ: ERROR writing data set " << column.name << std::endl;
             throw;
           }
         }
       }
 
       template<typename UserType>
-      void write2hdf(ArrayPushInput<UserType>& accessor, std::string& name, size_t decimationFactor,
-          H5::DataSpace& dataSpace) const;
+      using Column = typename H5storage<TRIGGERTYPE>::template Column<UserType>;
+
+      template<typename UserType>
+      void write2hdf(const DecimatedData<UserType>& data, Column<UserType>& column) const;
+
+      template<typename UserType>
+      void append2hdf(const DecimatedData<UserType>& data, H5::DataSet& dataSet, hsize_t row) const;
 
       H5storage<TRIGGERTYPE>& _storage;
+      const DAQSnapshot<TRIGGERTYPE>& _snapshot;
+      bool _rateGroupsOnly;
     };
 
     /******************************************************************************************************************/
 
     template<typename TRIGGERTYPE>
     template<typename UserType>
-    void H5DataWriter<TRIGGERTYPE>::write2hdf(ArrayPushInput<UserType>& accessor, std::string& dataSetName,
-        size_t decimationFactor, H5::DataSpace& dataSpace) const {
-      // prepare decimated buffer
-      size_t n = accessor.getNElements() / decimationFactor;
-      std::vector<float> buffer(n);
-      for(size_t i = 0; i < n; ++i) {
-        buffer[i] = userTypeToNumeric<float>(accessor[i * decimationFactor]);
+    void H5DataWriter<TRIGGERTYPE>::write2hdf(const DecimatedData<UserType>& data, Column<UserType>& column) const {
+      // filters require a chunked layout, use a single chunk for the entire data set
+      H5::DSetCreatPropList properties;
+      if(_storage.filters.enabled()) {
+        properties.setChunk(1, &column.nElements);
+        _storage.applyFilters(properties);
       }
 
-      // write data from internal buffer to data set in HDF5 file
-      H5::DataSet dataset{_storage.outFile->createDataSet(dataSetName, H5::PredType::NATIVE_FLOAT, dataSpace)};
-      dataset.write(buffer.data(), H5::PredType::NATIVE_FLOAT);
+      // the data set is created relative to the trigger group
+      H5::DataSet dataset{_storage.triggerGroup.createDataSet(
+          column.name, _storage.template fileType<UserType>(), column.dataSpace, properties)};
+      _storage.writeSelection(data.data, data.nElements, data.stride, dataset, column.dataSpace);
     }
 
     /******************************************************************************************************************/
 
     template<typename TRIGGERTYPE>
-    void H5storage<TRIGGERTYPE>::writeData() {
-      // format current time
-      struct timeval tv;
-      gettimeofday(&tv, nullptr);
-      time_t t = tv.tv_sec;
-      if(t == 0) t = time(nullptr);
-      struct tm* tmp = localtime(&t);
-      char timeString[64];
-      std::sprintf(timeString, "%04d-%02d-%02d %02d:%02d:%02d.%03d", 1900 + tmp->tm_year, tmp->tm_mon + 1, tmp->tm_mday,
-          tmp->tm_hour, tmp->tm_min, tmp->tm_sec, static_cast<int>(tv.tv_usec / 1000));
+    template<typename UserType>
+    void H5DataWriter<TRIGGERTYPE>::append2hdf(
+        const DecimatedData<UserType>& data, H5::DataSet& dataSet, hsize_t row) const {
+      auto fileSpace = _storage.extendRows(dataSet, row, data.nElements / data.stride, 1);
+      _storage.writeSelection(data.data, data.nElements, data.stride, dataSet, fileSpace);
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    template<typename UserType>
+    void H5storage<TRIGGERTYPE>::writeSelection(const UserType* buffer, hsize_t nElements, size_t decimationFactor,
+        H5::DataSet& dataSet, const H5::DataSpace& fileSpace) {
+      hsize_t n = nElements / decimationFactor;
+
+      if(convertToFloat) {
+        // legacy format: convert decimated data to float
+        std::vector<float> floatBuffer(n);
+        for(size_t i = 0; i < n; ++i) {
+          floatBuffer[i] = userTypeToNumeric<float>(buffer[i * decimationFactor]);
+        }
+        H5::DataSpace memorySpace(1, &n);
+        dataSet.write(floatBuffer.data(), H5::PredType::NATIVE_FLOAT, memorySpace, fileSpace);
+        bytesWritten += n * sizeof(float);
+      }
+      else if constexpr(std::is_same<UserType, std::string>::value) {
+        // variable-length strings are passed as array of pointers
+        std::vector<const char*> pointers(n);
+        for(size_t i = 0; i < n; ++i) {
+          pointers[i] = buffer[i * decimationFactor].c_str();
+          bytesWritten += buffer[i * decimationFactor].size();
+        }
+        H5::DataSpace memorySpace(1, &n);
+        dataSet.write(pointers.data(), h5Type<UserType>(), memorySpace, fileSpace);
+      }
+      else {
+        // decimation is done by HDF5 by selecting every decimationFactor-th element of the buffer
+        H5::DataSpace memorySpace(1, &nElements);
+        if(decimationFactor > 1) {
+          hsize_t start = 0, stride = decimationFactor;
+          memorySpace.selectHyperslab(H5S_SELECT_SET, &n, &start, &stride);
+        }
+        dataSet.write(buffer, h5Type<UserType>(), memorySpace, fileSpace);
+        bytesWritten += n * sizeof(UserType);
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::writeData(const DAQSnapshot<TRIGGERTYPE>& snapshot) {
+      // time stamp of the trigger is given in nanoseconds since epoch
+      int64_t timeStamp =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.version.getTime().time_since_epoch()).count();
+
+      // groups are named by the index of the trigger in the file, zero padded so they are sorted by name
+      char index[] = "/00000000";
+      auto pos = sizeof(index) - 1;
+      for(auto i = nRows; i > 0 && pos > 1; i /= 10) index[--pos] = char('0' + i % 10);
 
       // create groups
-      currentGroupName = std::string("/") + std::string(timeString);
       try {
-        outFile->createGroup(currentGroupName);
-        for(auto& group : groupList) outFile->createGroup(currentGroupName + "/" + group);
-        outFile->createGroup(currentGroupName + "/MicroDAQ");
+        triggerGroup = outFile->createGroup(index);
+        for(auto& group : groupList) triggerGroup.createGroup(group);
+        triggerGroup.createGroup("MicroDAQ");
+        if(timeAttribute) {
+          auto time = formatTime(snapshot.version.getTime());
+          H5::StrType type(H5::PredType::C_S1, time.size());
+          triggerGroup.createAttribute("time", type, H5::DataSpace(H5S_SCALAR)).write(type, time);
+        }
+
+        // write all data to file
+        boost::fusion::for_each(snapshot.buffers.table, H5DataWriter<TRIGGERTYPE>(*this, snapshot));
+
+        // write internal data
+        // ToDo: userTypeToNumeric<int64_t>(snapshot.nMissedTriggers) is not working for Boolean - Why?
+        TRIGGERTYPE tmpData = snapshot.nMissedTriggers;
+        H5::DataSet dataset{triggerGroup.createDataSet("MicroDAQ/nMissedTriggers", internalType(), _singleValueSpace)};
+        writeInternal(dataset, _singleValueSpace, userTypeToNumeric<int64_t>(tmpData));
+        H5::DataSet dataset1{triggerGroup.createDataSet("MicroDAQ/triggerPeriod", internalType(), _singleValueSpace)};
+        writeInternal(dataset1, _singleValueSpace, snapshot.triggerPeriod);
+        triggerGroup.createDataSet("MicroDAQ/timeStamp", H5::PredType::NATIVE_INT64, _singleValueSpace)
+            .write(&timeStamp, H5::PredType::NATIVE_INT64);
+        bytesWritten += sizeof(timeStamp);
+      }
+      catch(H5::Exception&) {
+        close(); // will re-open file on next trigger
+        return;
+      }
+      ++nRows;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    std::string H5storage<TRIGGERTYPE>::formatTime(const std::chrono::system_clock::time_point& time) {
+      time_t t = std::chrono::system_clock::to_time_t(time);
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+      struct tm tmp;
+      localtime_r(&t, &tmp);
+      char timeString[64];
+      std::snprintf(timeString, sizeof(timeString), "%04d-%02d-%02d %02d:%02d:%02d.%03d", 1900 + tmp.tm_year,
+          tmp.tm_mon + 1, tmp.tm_mday, tmp.tm_hour, tmp.tm_min, tmp.tm_sec, static_cast<int>(ms));
+      return timeString;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::createRecordLayout() {
+      // strings are of variable length and stay separate data sets
+      record.size = 0;
+      for(size_t memberSize : {8, 4, 2, 1}) {
+        boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+          using UserType = typename std::decay_t<decltype(pair)>::first_type;
+          if constexpr(!std::is_same<UserType, std::string>::value) {
+            if(sizeof(UserType) != memberSize) return;
+            for(auto& column : pair.second) {
+              column.inRecord = column.recorded && column.nElements == 1 && column.rateGroup == 0;
+              if(!column.inRecord) continue;
+              column.recordOffset = record.size;
+              record.size += sizeof(UserType);
+            }
+          }
+        });
+      }
+      if(record.size == 0) return;
+
+      record.type = H5::CompType(record.size);
+      boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+        using UserType = typename std::decay_t<decltype(pair)>::first_type;
+        for(auto& column : pair.second) {
+          if(column.inRecord) record.type.insertMember(column.name, column.recordOffset, h5Type<UserType>());
+        }
+      });
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::appendRecord() {
+      if(directChunkWrite) {
+        auto& chunk = record.chunk;
+        std::memcpy(chunk.data.data() + chunk.nFilled * record.size, record.rows.data(), record.size);
+        ++chunk.nFilled;
+        if(chunk.nFilled == chunk.nRows) submitChunk(chunk, record.dataSet);
+      }
+      else {
+        appendRow(record.dataSet, record.rows.data(), record.type, 1);
+      }
+      bytesWritten += record.size;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::createDataSets() {
+      nRows = 0;
+      nStaged = 0;
+      _stagedTriggerNumber.clear();
+      _stagedTimeStamp.clear();
+      _stagedMissedTriggers.clear();
+      _stagedTriggerPeriod.clear();
+      _pendingChunks.clear();
+
+      // create groups, groupList is sorted so lower levels get created first
+      for(auto& group : groupList) outFile->createGroup(group);
+      outFile->createGroup("/MicroDAQ");
+
+      // create data sets for all variables
+      boost::fusion::for_each(columnListMap.table, H5DataSetCreator<TRIGGERTYPE>(*this));
+      if(compoundScalars) {
+        record.dataSet = createExtendibleDataSet("/MicroDAQ/scalars", record.type, 1);
+        record.rows.assign(std::max(flushAfterNEntries, 1U) * record.size, 0);
+        record.chunk = {};
+        if(directChunkWrite) {
+          record.chunk.typeSize = record.size;
+          record.chunk.nRows = chunkRows(1, record.size);
+          record.chunk.data.resize(record.chunk.nRows * record.size);
+        }
+      }
+
+      // create data sets for internal data, shared by all variables
+      _internal.triggerNumber = createExtendibleDataSet("/MicroDAQ/triggerNumber", H5::PredType::NATIVE_UINT64, 1);
+      _internal.timeStamp = createExtendibleDataSet("/MicroDAQ/timeStamp", H5::PredType::NATIVE_INT64, 1);
+      _internal.nMissedTriggers = createExtendibleDataSet("/MicroDAQ/nMissedTriggers", internalType(), 1);
+      _internal.triggerPeriod = createExtendibleDataSet("/MicroDAQ/triggerPeriod", internalType(), 1);
+
+      // trigger index of each rate group
+      _rateGroupIndex.clear();
+      if(!_owner->_rateGroups.empty()) outFile->createGroup("/MicroDAQ/rateGroups");
+      for(auto& group : _owner->_rateGroups) {
+        std::string path = "/MicroDAQ/rateGroups/" + group.name;
+        outFile->createGroup(path);
+        _rateGroupIndex.push_back({createExtendibleDataSet(path + "/triggerNumber", H5::PredType::NATIVE_UINT64, 1),
+            createExtendibleDataSet(path + "/timeStamp", H5::PredType::NATIVE_INT64, 1)});
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::appendRateGroupIndex(uint64_t triggerNumber, int64_t timeStamp) {
+      for(size_t i = 0; i < _rateGroupIndex.size(); ++i) {
+        if(!isDue(i + 1, triggerNumber)) continue;
+        auto& group = _rateGroupIndex[i];
+        extendRow(group.triggerNumber, group.nRows, &triggerNumber, H5::PredType::NATIVE_UINT64, 1);
+        extendRow(group.timeStamp, group.nRows, &timeStamp, H5::PredType::NATIVE_INT64, 1);
+        ++group.nRows;
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::appendData(const DAQSnapshot<TRIGGERTYPE>& snapshot) {
+      // time stamp of the trigger is given in nanoseconds since epoch
+      int64_t timeStamp =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.version.getTime().time_since_epoch()).count();
+      TRIGGERTYPE tmpData = snapshot.nMissedTriggers;
+
+      try {
+        if(flushAfterNEntries > 1) {
+          // copy to the staging buffers, which are written once they are full
+          boost::fusion::for_each(snapshot.buffers.table, H5DataStager<TRIGGERTYPE>(*this, snapshot));
+          if(!_rateGroupIndex.empty()) {
+            boost::fusion::for_each(snapshot.buffers.table, H5DataWriter<TRIGGERTYPE>(*this, snapshot, true));
+            appendRateGroupIndex(snapshot.triggerNumber, timeStamp);
+          }
+          _stagedTriggerNumber.push_back(snapshot.triggerNumber);
+          _stagedTimeStamp.push_back(timeStamp);
+          _stagedMissedTriggers.push_back(userTypeToNumeric<int64_t>(tmpData));
+          _stagedTriggerPeriod.push_back(snapshot.triggerPeriod);
+          ++nStaged;
+          if(nStaged == flushAfterNEntries) flushStaged();
+          return;
+        }
+
+        // write all data to file
+        boost::fusion::for_each(snapshot.buffers.table, H5DataWriter<TRIGGERTYPE>(*this, snapshot));
+        appendRateGroupIndex(snapshot.triggerNumber, timeStamp);
+        if(compoundScalars) appendRecord();
+        if(directChunkWrite) writeCompressedChunks(false);
+
+        // write internal data
+        appendRow(_internal.triggerNumber, &snapshot.triggerNumber, H5::PredType::NATIVE_UINT64, 1);
+        appendRow(_internal.timeStamp, &timeStamp, H5::PredType::NATIVE_INT64, 1);
+        auto& nMissedTriggers = _internal.nMissedTriggers;
+        writeInternal(nMissedTriggers, appendRow(nMissedTriggers, 1), userTypeToNumeric<int64_t>(tmpData));
+        auto& triggerPeriod = _internal.triggerPeriod;
+        writeInternal(triggerPeriod, appendRow(triggerPeriod, 1), snapshot.triggerPeriod);
+      }
+      catch(H5::Exception&) {
+        close(); // will re-open file on next trigger
+        return;
+      }
+      ++nRows;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::flushStaged() {
+      if(nStaged == 0) return;
+
+      // reset first, so the staged rows are discarded if writing fails
+      hsize_t nNewRows = nStaged;
+      nStaged = 0;
+
+      boost::fusion::for_each(columnListMap.table, H5StagedDataWriter<TRIGGERTYPE>(*this, nNewRows));
+      if(compoundScalars) {
+        auto fileSpace = appendRows(record.dataSet, 1, nNewRows);
+        H5::DataSpace memorySpace(1, &nNewRows);
+        record.dataSet.write(record.rows.data(), record.type, memorySpace, fileSpace);
+        bytesWritten += nNewRows * record.size;
+      }
+
+      auto& triggerNumber = _internal.triggerNumber;
+      auto fileSpace = appendRows(triggerNumber, 1, nNewRows);
+      H5::DataSpace memorySpace(1, &nNewRows);
+      triggerNumber.write(_stagedTriggerNumber.data(), H5::PredType::NATIVE_UINT64, memorySpace, fileSpace);
+      auto& timeStamp = _internal.timeStamp;
+      fileSpace = appendRows(timeStamp, 1, nNewRows);
+      timeStamp.write(_stagedTimeStamp.data(), H5::PredType::NATIVE_INT64, memorySpace, fileSpace);
+      auto& nMissedTriggers = _internal.nMissedTriggers;
+      writeInternal(nMissedTriggers, appendRows(nMissedTriggers, 1, nNewRows), _stagedMissedTriggers.data(), nNewRows);
+      auto& triggerPeriod = _internal.triggerPeriod;
+      writeInternal(triggerPeriod, appendRows(triggerPeriod, 1, nNewRows), _stagedTriggerPeriod.data(), nNewRows);
+
+      _stagedTriggerNumber.clear();
+      _stagedTimeStamp.clear();
+      _stagedMissedTriggers.clear();
+      _stagedTriggerPeriod.clear();
+      nRows += nNewRows;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::flushForReaders() {
+      if(!swmrMode || nRows - nRowsFlushed < std::max(swmrFlushPeriod, 1U)) return;
+      try {
+        outFile->flush(H5F_SCOPE_LOCAL);
+        nRowsFlushed = nRows;
+      }
+      catch(H5::Exception&) {
+        std::cerr << "HDF5DAQ: Failed to flush file for SWMR readers." << std::endl;
+      }
+    }
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    template<typename UserType>
+    bool H5storage<TRIGGERTYPE>::recordIfChanged(
+        SparseColumn<UserType>& column, const DecimatedData<UserType>& data, const VersionNumber& version, hsize_t row) {
+      // the first row of each file is always recorded, since lastVersion is reset for each file
+      if(version == column.lastVersion) return false;
+      column.lastVersion = version;
+      column.values.push_back(data.data[0]);
+      column.rows.push_back(row);
+      return true;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    template<typename UserType>
+    void H5storage<TRIGGERTYPE>::flushSparse(SparseColumn<UserType>& column, H5::DataSet& dataSet) {
+      hsize_t n = column.values.size();
+      if(n == 0) return;
+
+      auto fileSpace = extendRows(dataSet, column.nWritten, 1, n);
+      writeSelection(column.values.data(), n, 1, dataSet, fileSpace);
+      fileSpace = extendRows(column.rowDataSet, column.nWritten, 1, n);
+      H5::DataSpace memorySpace(1, &n);
+      column.rowDataSet.write(column.rows.data(), H5::PredType::NATIVE_UINT64, memorySpace, fileSpace);
+      bytesWritten += n * sizeof(uint64_t);
+
+      column.nWritten += n;
+      column.values.clear();
+      column.rows.clear();
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    template<typename UserType>
+    void H5storage<TRIGGERTYPE>::appendToChunk(
+        ChunkBuffer& chunk, H5::DataSet& dataSet, const DecimatedData<UserType>& data) {
+      size_t n = data.nElements / data.stride;
+      if(convertToFloat) {
+        auto* row = reinterpret_cast<float*>(chunk.data.data()) + chunk.nFilled * n;
+        for(size_t i = 0; i < n; ++i) row[i] = userTypeToNumeric<float>(data.data[i * data.stride]);
+      }
+      else if constexpr(!std::is_same<UserType, std::string>::value) {
+        auto* row = reinterpret_cast<UserType*>(chunk.data.data()) + chunk.nFilled * n;
+        for(size_t i = 0; i < n; ++i) row[i] = data.data[i * data.stride];
+      }
+      bytesWritten += n * chunk.typeSize;
+
+      ++chunk.nFilled;
+      if(chunk.nFilled == chunk.nRows) submitChunk(chunk, dataSet);
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::submitChunk(ChunkBuffer& chunk, H5::DataSet& dataSet) {
+      auto size = chunk.data.size();
+      _pendingChunks.push_back(PendingChunk{dataSet, chunk.index * chunk.nRows, chunk.nFilled,
+          _compressor->compress(std::move(chunk.data), chunk.typeSize, filters.shuffle, filters.level)});
+
+      // unused rows of a partially filled chunk are beyond the extent of the data set, but must be initialised
+      chunk.data.assign(size, 0);
+      chunk.nFilled = 0;
+      ++chunk.index;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::writeCompressedChunks(bool wait) {
+      while(!_pendingChunks.empty()) {
+        auto& pending = _pendingChunks.front();
+        if(!wait && pending.data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) break;
+        std::vector<char> data;
+        try {
+          data = pending.data.get();
+        }
+        catch(std::runtime_error& e) {
+          throw H5::DataSetIException("H5storage::writeCompressedChunks", e.what());
+        }
+
+        // the data set is extended when the chunk is written, so it never contains rows not yet written
+        hsize_t dims[2];
+        auto space = pending.dataSet.getSpace();
+        space.getSimpleExtentDims(dims);
+        if(dims[0] < pending.offset + pending.nRows) {
+          dims[0] = pending.offset + pending.nRows;
+          pending.dataSet.extend(dims);
+        }
+
+        // filter mask 0: all filters of the data set have been applied
+        hsize_t offset[2] = {pending.offset, 0};
+        if(H5Dwrite_chunk(pending.dataSet.getId(), H5P_DEFAULT, 0, offset, data.size(), data.data()) < 0) {
+          throw H5::DataSetIException("H5storage::writeCompressedChunks", "H5Dwrite_chunk failed");
+        }
+        _pendingChunks.pop_front();
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::flushChunks() {
+      boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+        for(auto& column : pair.second) {
+          if(column.chunk.nFilled > 0) submitChunk(column.chunk, column.dataSet);
+        }
+      });
+      if(compoundScalars && record.chunk.nFilled > 0) submitChunk(record.chunk, record.dataSet);
+      writeCompressedChunks(true);
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    hsize_t H5storage<TRIGGERTYPE>::chunkRows(hsize_t nElements, size_t typeSize) const {
+      // chunk along the trigger dimension, but not beyond the number of triggers stored in the file
+      assert(nElements > 0 && typeSize > 0);
+      hsize_t rows = std::max<hsize_t>(1, _chunkSize / (nElements * typeSize));
+      if(nTriggersPerFile > 0) rows = std::min<hsize_t>(rows, nTriggersPerFile);
+      return rows;
+    }
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    H5::DataSet H5storage<TRIGGERTYPE>::createExtendibleDataSet(
+        const std::string& name, const H5::DataType& type, hsize_t nElements) {
+      int rank = nElements > 1 ? 2 : 1;
+      hsize_t dims[2] = {0, nElements};
+      hsize_t maxDims[2] = {H5S_UNLIMITED, nElements};
+      H5::DataSpace space(rank, dims, maxDims);
+
+      hsize_t chunkDims[2] = {chunkRows(nElements, type.getSize()), nElements};
+      H5::DSetCreatPropList properties;
+      properties.setChunk(rank, chunkDims);
+      applyFilters(properties);
+
+      return outFile->createDataSet(name, type, space, properties);
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::writeInternal(
+        H5::DataSet& dataSet, const H5::DataSpace& fileSpace, const int64_t* values, hsize_t n) {
+      H5::DataSpace memorySpace(1, &n);
+      if(convertToFloat) {
+        std::vector<float> buffer(values, values + n);
+        dataSet.write(buffer.data(), H5::PredType::NATIVE_FLOAT, memorySpace, fileSpace);
+        bytesWritten += n * sizeof(float);
+      }
+      else {
+        dataSet.write(values, H5::PredType::NATIVE_INT64, memorySpace, fileSpace);
+        bytesWritten += n * sizeof(int64_t);
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::close() {
+      if(!outFile) return;
+
+      // staged rows and chunks must be written before the file is closed (rollover or DAQ disabled)
+      try {
+        flushStaged();
+        if(directChunkWrite) flushChunks();
+      }
+      catch(H5::Exception&) {
+        std::cerr << "HDF5DAQ: Failed to write staged data." << std::endl;
       }
-      catch(H5::FileIException&) {
+      _pendingChunks.clear();
+
+      // compression ratio: uncompressed size of the data compared to the size of the file (including meta data)
+      try {
+        auto fileSize = outFile->getFileSize();
+        if(fileSize > 0) {
+          _compressionRatio = static_cast<float>(bytesWritten) / static_cast<float>(fileSize);
+          _compressionRatioChanged = true;
+        }
         outFile->close();
-        isOpened = false; // will re-open file on next trigger
+      }
+      catch(H5::Exception&) {
+        std::cerr << "HDF5DAQ: Failed to close file." << std::endl;
+      }
+      outFile.reset();
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::updateStatus() {
+      if(_compressionRatioChanged.exchange(false)) {
+        _owner->compressionRatio = _compressionRatio;
+        _owner->compressionRatio.write();
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::setFilters(const H5FileSettings& settings) {
+      std::string algorithm = settings.compressionAlgorithm;
+      std::transform(
+          algorithm.begin(), algorithm.end(), algorithm.begin(), [](unsigned char c) { return std::tolower(c); });
+
+      filters = Filters{};
+      filters.shuffle = settings.shuffle;
+      filters.level = settings.compressionLevel;
+      if(algorithm.empty() || algorithm == "none") {
         return;
       }
+      if(algorithm == "deflate") {
+        filters.filter = H5Z_FILTER_DEFLATE;
+      }
+      else if(algorithm == "lzf") {
+        filters.filter = _filterLZF;
+      }
+      else if(algorithm == "zstd") {
+        filters.filter = _filterZstd;
+      }
+      else {
+        std::cerr << "HDF5DAQ: Unknown compression algorithm '" << algorithm << "'. Using deflate instead."
+                  << std::endl;
+        filters.filter = H5Z_FILTER_DEFLATE;
+      }
+
+      // filter plugins are loaded by the HDF5 library on demand, fall back to the built-in deflate filter
+      if(filters.filter != H5Z_FILTER_DEFLATE && H5Zfilter_avail(filters.filter) <= 0) {
+        std::cerr << "HDF5DAQ: Filter plugin for compression algorithm '" << algorithm
+                  << "' not available. Using deflate instead." << std::endl;
+        filters.filter = H5Z_FILTER_DEFLATE;
+      }
+      if(filters.filter == H5Z_FILTER_DEFLATE) {
+        filters.level = std::min(filters.level, 9U);
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::applyFilters(H5::DSetCreatPropList& properties) const {
+      if(filters.shuffle) {
+        properties.setShuffle();
+      }
+      if(filters.filter == H5Z_FILTER_DEFLATE) {
+        properties.setDeflate(filters.level);
+      }
+      else if(filters.filter == _filterZstd) {
+        properties.setFilter(filters.filter, H5Z_FLAG_OPTIONAL, 1, &filters.level);
+      }
+      else if(filters.filter != H5Z_FILTER_NONE) {
+        properties.setFilter(filters.filter, H5Z_FLAG_OPTIONAL);
+      }
+    }
+
+    /******************************************************************************************************************/
 
-      // write all data to file
-      boost::fusion::for_each(_owner->BaseDAQ<TRIGGERTYPE>::_accessorListMap.table, H5DataWriter<TRIGGERTYPE>(*this));
-
-      // write internal data
-      // ToDo: userTypeToNumeric<float>((TRIGGERTYPE)_owner->BaseDAQ<TRIGGERTYPE>::status.nMissedTriggers) is not
-      // working for Boolean - Why?
-      TRIGGERTYPE tmpData = _owner->BaseDAQ<TRIGGERTYPE>::status.nMissedTriggers;
-      _buffer[0] = userTypeToNumeric<float>(tmpData);
-      H5::DataSet dataset{outFile->createDataSet(currentGroupName + "/MicroDAQ/nMissedTriggers",
-          H5::PredType::NATIVE_FLOAT, _space["MicroDAQ.nMissedTriggers"])};
-      dataset.write(_buffer.data(), H5::PredType::NATIVE_FLOAT);
-      H5::DataSet dataset1{outFile->createDataSet(
-          currentGroupName + "/MicroDAQ/triggerPeriod", H5::PredType::NATIVE_FLOAT, _space["MicroDAQ.triggerPeriod"])};
-      _buffer[0] = userTypeToNumeric<float>((int64_t)_owner->BaseDAQ<TRIGGERTYPE>::status.triggerPeriod);
-      dataset1.write(_buffer.data(), H5::PredType::NATIVE_FLOAT);
+    template<typename TRIGGERTYPE>
+    H5::DataSpace H5storage<TRIGGERTYPE>::extendRows(
+        H5::DataSet& dataSet, hsize_t firstRow, hsize_t nElements, hsize_t nNewRows) {
+      // extend by the new rows (the size of the second dimension is ignored for scalars)
+      hsize_t dims[2] = {firstRow + nNewRows, nElements};
+      dataSet.extend(dims);
+
+      // select the new rows in the file
+      H5::DataSpace fileSpace = dataSet.getSpace();
+      hsize_t start[2] = {firstRow, 0};
+      hsize_t count[2] = {nNewRows, nElements};
+      fileSpace.selectHyperslab(H5S_SELECT_SET, count, start);
+      return fileSpace;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void H5storage<TRIGGERTYPE>::extendRow(
+        H5::DataSet& dataSet, hsize_t firstRow, const void* buffer, const H5::DataType& type, hsize_t nElements) {
+      auto fileSpace = extendRows(dataSet, firstRow, nElements, 1);
+      H5::DataSpace memorySpace(1, &nElements);
+      dataSet.write(buffer, type, memorySpace, fileSpace);
     }
 
     /******************************************************************************************************************/
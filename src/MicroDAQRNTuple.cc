@@ -0,0 +1,418 @@
+// SPDX-FileCopyrightText: Helmholtz-Zentrum Dresden-Rossendorf, FWKE, ChimeraTK Project <chimeratk-support@desy.de>
+// SPDX-License-Identifier: LGPL-3.0-or-later
+#include "MicroDAQRNTuple.h"
+
+#include "ROOTCompression.h"
+#include "TFile.h"
+#include "TROOT.h"
+
+#include <ROOT/REntry.hxx>
+#include <ROOT/RError.hxx>
+#include <ROOT/RField.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ChimeraTK {
+
+  namespace detail {
+
+    /******************************************************************************************************************/
+
+    /**
+     * RNTuple type name of the ChimeraTK data types. ChimeraTK::Boolean has the layout of bool.
+     */
+    template<typename UserType>
+    struct FieldType {};
+    template<>
+    struct FieldType<int8_t> {
+      static constexpr const char* name = "std::int8_t";
+    };
+    template<>
+    struct FieldType<uint8_t> {
+      static constexpr const char* name = "std::uint8_t";
+    };
+    template<>
+    struct FieldType<int16_t> {
+      static constexpr const char* name = "std::int16_t";
+    };
+    template<>
+    struct FieldType<uint16_t> {
+      static constexpr const char* name = "std::uint16_t";
+    };
+    template<>
+    struct FieldType<int32_t> {
+      static constexpr const char* name = "std::int32_t";
+    };
+    template<>
+    struct FieldType<uint32_t> {
+      static constexpr const char* name = "std::uint32_t";
+    };
+    template<>
+    struct FieldType<int64_t> {
+      static constexpr const char* name = "std::int64_t";
+    };
+    template<>
+    struct FieldType<uint64_t> {
+      static constexpr const char* name = "std::uint64_t";
+    };
+    template<>
+    struct FieldType<float> {
+      static constexpr const char* name = "float";
+    };
+    template<>
+    struct FieldType<double> {
+      static constexpr const char* name = "double";
+    };
+    template<>
+    struct FieldType<Boolean> {
+      static_assert(sizeof(Boolean) == sizeof(bool), "ChimeraTK::Boolean must have the layout of bool");
+      static constexpr const char* name = "bool";
+    };
+    template<>
+    struct FieldType<std::string> {
+      static constexpr const char* name = "std::string";
+    };
+
+    /******************************************************************************************************************/
+
+    /**
+     * Settings of the RNTupleDAQ control variables applied to a single file.
+     */
+    struct RNTupleFileSettings : FileSettings {
+      uint32_t flushAfterNEntries{0};
+      std::string compressionAlgorithm;
+      uint32_t compressionLevel{0};
+    };
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    struct RNTupleStorage : DAQStorage<TRIGGERTYPE> {
+      RNTupleStorage(RNTupleDAQ<TRIGGERTYPE>* owner) : _owner(owner) {}
+      ~RNTupleStorage() override { close(); }
+
+      void close() override {
+        // the writers commit the remaining entries when destroyed, which must happen before the file is closed
+        for(auto& group : rateGroupWriters) {
+          group.entry.reset();
+          group.writer.reset();
+        }
+        entry.reset();
+        writer.reset();
+        if(file) file->Close();
+        file.reset();
+      }
+
+      std::shared_ptr<FileSettings> getFileSettings() override;
+      bool open(const std::string& fileName, const FileSettings* settings) override;
+      bool write(const DAQSnapshot<TRIGGERTYPE>& snapshot) override;
+
+      /**
+       * Entry of the write plan: the decimation of a single variable and its field, compiled when the DAQ is started.
+       * The field is bound directly to the snapshot buffer or the decimator. Only values which are not contiguous in
+       * memory (decimation by picking every n-th value) and strings are copied to the staging buffer.
+       */
+      template<typename UserType>
+      struct Column {
+        Column(const DecimationSettings& settings, size_t nInputElements, const std::string& name)
+        : decimator(settings, nInputElements), fieldName(name), isArray(nInputElements > 1),
+          staging(std::max<size_t>(decimator.nDecimated, 1)) {
+          assert(decimator.nDecimated > 0); // ensured by BaseDAQ::resolveDecimation()
+        }
+
+        Decimator<UserType> decimator;
+        std::string fieldName;
+        bool isArray;
+        std::vector<UserType> staging;
+        std::optional<ROOT::REntry::RFieldToken> token; ///< Field in the entry of the current file
+        bool recorded{true}; ///< Variable is recorded in the current file (see FileSettings::recorded)
+        size_t rateGroup{0}; ///< Rate group of the variable, 0 if recorded on each trigger
+
+        /** Arrays are stored with the fixed decimated length, arrays of strings as std::vector<std::string> */
+        std::string typeName() const {
+          if(!isArray) return FieldType<UserType>::name;
+          if(std::is_same<UserType, std::string>::value) return "std::vector<std::string>";
+          return std::string("std::array<") + FieldType<UserType>::name + "," + std::to_string(staging.size()) + ">";
+        }
+
+        void* stagingAddress() {
+          if constexpr(std::is_same<UserType, std::string>::value) {
+            if(isArray) return &staging;
+          }
+          return static_cast<void*>(staging.data());
+        }
+      };
+
+      /** boost::fusion::map of UserTypes to vectors containing the write plan, in the same order as the buffers of the
+       * snapshot. */
+      template<typename UserType>
+      using columnList = std::vector<Column<UserType>>;
+      TemplateUserTypeMapNoVoid<columnList> columnListMap;
+
+      /** File of the current RNTuple and the RNTuples of the rate groups */
+      std::unique_ptr<TFile> file;
+
+      std::unique_ptr<ROOT::RNTupleWriter> writer;
+      std::unique_ptr<ROOT::REntry> entry;
+
+      /**
+       * RNTuple of a rate group (see BaseDAQ::addRateGroup()), named <ntupleName>_<group name>. It contains the fields
+       * of the variables of the group, the trigger number and the time stamp, and is only filled on the triggers the
+       * group is due.
+       */
+      struct RateGroupWriter {
+        std::unique_ptr<ROOT::RNTupleWriter> writer;
+        std::unique_ptr<ROOT::REntry> entry;
+        std::uint64_t triggerNumber{0};
+        std::int64_t timeStampNs{0};
+      };
+
+      /** Writers of the rate groups in the order of the groups, allocated once so the bound addresses stay valid */
+      std::vector<RateGroupWriter> rateGroupWriters;
+
+      /** Entry the field of a variable in the given rate group is bound to */
+      ROOT::REntry& entryOf(size_t rateGroup) {
+        return rateGroup == 0 ? *entry : *rateGroupWriters[rateGroup - 1].entry;
+      }
+
+      // internal data, bound to the entry when opening a file
+      std::uint64_t triggerNumber{0};
+      std::int64_t timeStampNs{0};
+      TRIGGERTYPE nMissedTriggers{};
+      std::int64_t triggerPeriod{0};
+
+      /** Number of entries after which the cluster is committed, taken from RNTupleDAQ::flushAfterNEntries */
+      uint32_t flushAfterNEntries{0};
+
+      RNTupleDAQ<TRIGGERTYPE>* _owner;
+
+      /**
+       *  Collect all accessors that use the DAQ trigger as external trigger.
+       *  This does not really belong to storage but since we iterate over all accessors here
+       *  we include that step here.
+       */
+      std::vector<TransferElementID> _accessorsWithTrigger;
+    };
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    struct RNTupleFieldCreator {
+      RNTupleFieldCreator(RNTupleStorage<TRIGGERTYPE>& storage) : _storage(storage) {}
+
+      template<typename PAIR>
+      void operator()(PAIR& pair) const {
+        typedef typename PAIR::first_type UserType;
+
+        // get the lists for the UserType
+        auto& accessorList = pair.second;
+        auto& columnList = boost::fusion::at_key<UserType>(_storage.columnListMap.table);
+        auto& nameList = boost::fusion::at_key<UserType>(_storage._owner->_nameListMap.table);
+        auto& decimationList = boost::fusion::at_key<UserType>(_storage._owner->_decimationListMap.table);
+        auto& rateGroupList = boost::fusion::at_key<UserType>(_storage._owner->_rateGroupListMap.table);
+
+        // iterate through all accessors for this UserType
+        columnList.reserve(accessorList.size());
+        auto name = nameList.begin();
+        auto decimation = decimationList.begin();
+        auto rateGroup = rateGroupList.begin();
+        for(auto accessor = accessorList.begin(); accessor != accessorList.end();
+            ++accessor, ++name, ++decimation, ++rateGroup) {
+          // check if accessor uses DAQ trigger as external trigger
+          if(_storage._owner->isAccessorUsingDAQTrigger(*accessor)) {
+            _storage._accessorsWithTrigger.push_back(accessor->getId());
+          }
+
+          // field names are the DAQ names without the leading '/', RNTuple does not allow '.' in field names
+          if(name->at(0) != '/') throw ChimeraTK::logic_error("Unexpected register name.");
+          auto& column = columnList.emplace_back(*decimation, accessor->getNElements(), name->substr(1));
+          column.rateGroup = *rateGroup;
+        }
+      }
+
+      RNTupleStorage<TRIGGERTYPE>& _storage;
+    };
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    std::shared_ptr<FileSettings> RNTupleStorage<TRIGGERTYPE>::getFileSettings() {
+      auto settings = std::make_shared<RNTupleFileSettings>();
+      settings->flushAfterNEntries = _owner->flushAfterNEntries;
+      settings->compressionAlgorithm = (std::string)_owner->compressionAlgorithm;
+      settings->compressionLevel = _owner->compressionLevel;
+      return settings;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    bool RNTupleStorage<TRIGGERTYPE>::open(const std::string& fileName, const FileSettings* settings) {
+      auto& ntupleSettings = *static_cast<const RNTupleFileSettings*>(settings);
+      flushAfterNEntries = ntupleSettings.flushAfterNEntries;
+      applyRecordedMask(columnListMap, ntupleSettings);
+
+      // the writers of a previous file must be destroyed before its TFile is replaced
+      close();
+
+      try {
+        // all RNTuples are written to the same file
+        file.reset(TFile::Open(fileName.c_str(), "RECREATE"));
+        if(!file || file->IsZombie()) {
+          std::cerr << "RNTupleDAQ: Failed to create file " << fileName << std::endl;
+          close();
+          return false;
+        }
+
+        // the models are handed over to the writers, so they are created for each file
+        auto createModel = [&](size_t rateGroup) {
+          auto model = ROOT::RNTupleModel::CreateBare();
+          boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+            for(auto& column : pair.second) {
+              if(!column.recorded || column.rateGroup != rateGroup) continue;
+              model->AddField(ROOT::RFieldBase::Create(column.fieldName, column.typeName()).Unwrap());
+            }
+          });
+          model->AddField(ROOT::RFieldBase::Create("MicroDAQ/triggerNumber", "std::uint64_t").Unwrap());
+          model->AddField(ROOT::RFieldBase::Create("MicroDAQ/timeStampNs", "std::int64_t").Unwrap());
+          return model;
+        };
+        auto model = createModel(0);
+        model->AddField(ROOT::RFieldBase::Create("MicroDAQ/nMissedTriggers", FieldType<TRIGGERTYPE>::name).Unwrap());
+        model->AddField(ROOT::RFieldBase::Create("MicroDAQ/triggerPeriod", "std::int64_t").Unwrap());
+
+        ROOT::RNTupleWriteOptions options;
+        options.SetCompression(
+            rootCompressionSettings(ntupleSettings.compressionAlgorithm, ntupleSettings.compressionLevel));
+        writer = ROOT::RNTupleWriter::Append(std::move(model), _owner->_ntupleName, *file, options);
+        entry = writer->CreateEntry();
+        entry->BindRawPtr("MicroDAQ/triggerNumber", static_cast<void*>(&triggerNumber));
+        entry->BindRawPtr("MicroDAQ/timeStampNs", static_cast<void*>(&timeStampNs));
+        entry->BindRawPtr("MicroDAQ/nMissedTriggers", static_cast<void*>(&nMissedTriggers));
+        entry->BindRawPtr("MicroDAQ/triggerPeriod", static_cast<void*>(&triggerPeriod));
+
+        for(size_t i = 0; i < rateGroupWriters.size(); ++i) {
+          auto& group = rateGroupWriters[i];
+          auto name = _owner->_ntupleName + "_" + _owner->_rateGroups[i].name;
+          group.writer = ROOT::RNTupleWriter::Append(createModel(i + 1), name, *file, options);
+          group.entry = group.writer->CreateEntry();
+          group.entry->BindRawPtr("MicroDAQ/triggerNumber", static_cast<void*>(&group.triggerNumber));
+          group.entry->BindRawPtr("MicroDAQ/timeStampNs", static_cast<void*>(&group.timeStampNs));
+        }
+
+        // bind the fields once, only the fields bound to the snapshot buffers are rebound for each trigger
+        boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+          for(auto& column : pair.second) {
+            column.token.reset();
+            if(!column.recorded) continue;
+            auto& columnEntry = entryOf(column.rateGroup);
+            column.token = columnEntry.GetToken(column.fieldName);
+            columnEntry.BindRawPtr(*column.token, column.stagingAddress());
+          }
+        });
+      }
+      catch(ROOT::RException& e) {
+        std::cerr << "RNTupleDAQ: Failed to create file " << fileName << ": " << e.what() << std::endl;
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    bool RNTupleStorage<TRIGGERTYPE>::write(const DAQSnapshot<TRIGGERTYPE>& snapshot) {
+      if(!writer) return false;
+
+      triggerNumber = snapshot.triggerNumber;
+      timeStampNs =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.version.getTime().time_since_epoch()).count();
+      nMissedTriggers = snapshot.nMissedTriggers;
+      triggerPeriod = snapshot.triggerPeriod;
+
+      boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+        using UserType = typename std::remove_reference_t<decltype(pair)>::first_type;
+        auto& bufferList = boost::fusion::at_key<UserType>(snapshot.buffers.table);
+        auto& columnList = pair.second;
+        for(size_t i = 0; i < columnList.size(); ++i) {
+          auto& column = columnList[i];
+          if(!column.recorded || !_owner->isRateGroupDue(column.rateGroup, snapshot.triggerNumber)) continue;
+          auto decimated = column.decimator(bufferList[i]);
+          if(std::is_same<UserType, std::string>::value || decimated.stride != 1) {
+            for(size_t k = 0; k < column.decimator.nDecimated; k++) {
+              column.staging[k] = decimated.data[k * decimated.stride];
+            }
+          }
+          else {
+            // the snapshot buffers are reused, so the field is bound to the current buffer for each trigger
+            entryOf(column.rateGroup)
+                .BindRawPtr(*column.token, static_cast<void*>(const_cast<UserType*>(decimated.data)));
+          }
+        }
+      });
+
+      try {
+        writer->Fill(*entry);
+        if(flushAfterNEntries > 0 && writer->GetNEntries() % flushAfterNEntries == 0) writer->CommitCluster();
+        for(size_t i = 0; i < rateGroupWriters.size(); ++i) {
+          if(!_owner->isRateGroupDue(i + 1, snapshot.triggerNumber)) continue;
+          auto& group = rateGroupWriters[i];
+          group.triggerNumber = snapshot.triggerNumber;
+          group.timeStampNs = timeStampNs;
+          group.writer->Fill(*group.entry);
+        }
+      }
+      catch(ROOT::RException& e) {
+        std::cerr << "RNTupleDAQ: Failed to write entry: " << e.what() << std::endl;
+        close();
+        return false;
+      }
+      return true;
+    }
+
+    /******************************************************************************************************************/
+
+  } // namespace detail
+
+  /********************************************************************************************************************/
+
+  template<typename TRIGGERTYPE>
+  void RNTupleDAQ<TRIGGERTYPE>::mainLoop() {
+    std::cout << "Initializing RNTupleDAQ system..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+
+    // storage object
+    detail::RNTupleStorage<TRIGGERTYPE> storage(this);
+
+    // create the write plan and look for accessors using the DAQ trigger as external node
+    boost::fusion::for_each(
+        BaseDAQ<TRIGGERTYPE>::_accessorListMap.table, detail::RNTupleFieldCreator<TRIGGERTYPE>(storage));
+
+    // add trigger
+    storage._accessorsWithTrigger.push_back(BaseDAQ<TRIGGERTYPE>::trigger.getId());
+    storage.rateGroupWriters.resize(BaseDAQ<TRIGGERTYPE>::_rateGroups.size());
+
+    // files are written by a separate thread in asynchronous mode
+    if(BaseDAQ<TRIGGERTYPE>::_writerQueueLength > 0) ROOT::EnableThreadSafety();
+
+    BaseDAQ<TRIGGERTYPE>::_startupTimes.writePlan = std::chrono::steady_clock::now() - start;
+    BaseDAQ<TRIGGERTYPE>::runDAQ(storage, storage._accessorsWithTrigger);
+  }
+
+  /********************************************************************************************************************/
+
+  INSTANTIATE_TEMPLATE_FOR_CHIMERATK_USER_TYPES_NO_VOID(RNTupleDAQ);
+
+  /********************************************************************************************************************/
+
+} // namespace ChimeraTK
@@ -10,11 +10,23 @@
 #include "MicroDAQROOT.h"
 
 #include "data_types.h"
+#include "ROOTCompression.h"
 #include "TFile.h"
+#include "TROOT.h"
 #include "TTimeStamp.h"
 #include "TTree.h"
 
-#include <list>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace ChimeraTK {
 
@@ -22,49 +34,276 @@ namespace ChimeraTK {
 
     /******************************************************************************************************************/
 
-    template<typename TRIGGERTYPE>
-    struct ROOTstorage {
-      ROOTstorage(RootDAQ<TRIGGERTYPE>* owner) : outFile(nullptr), tree(nullptr), _owner(owner) {
-        missedTrigger.parameter["missedTrigger"];
+    /**
+     * Settings of the RootDAQ control variables applied to a single file.
+     */
+    struct ROOTFileSettings : FileSettings {
+      uint32_t flushAfterNEntries{0};
+      uint32_t autoSavePeriod{0};
+      std::string compressionAlgorithm;
+      uint32_t compressionLevel{0};
+      uint32_t compressionThreads{0};
+      uint32_t clusterSize{0};
+      bool compoundScalars{false};
+    };
+
+    /******************************************************************************************************************/
+
+    /**
+     * Create a branch for the values in the given buffer, using the leaf type matching the UserType. Arrays are stored
+     * with the fixed length of the buffer. Strings are stored as std::string or std::vector<std::string>.
+     */
+    template<typename UserType>
+    TBranch* createBranch(TTree* tree, const std::string& name, std::vector<UserType>& buffer, bool isArray) {
+      if constexpr(std::is_same<UserType, std::string>::value) {
+        if(isArray) return tree->Branch(name.c_str(), &buffer);
+        return tree->Branch(name.c_str(), buffer.data());
+      }
+      else {
+        std::string leafList = name;
+        if(isArray) leafList += "[" + std::to_string(buffer.size()) + "]";
+        leafList += std::string("/") + LeafType<UserType>::code;
+        return tree->Branch(name.c_str(), static_cast<void*>(buffer.data()), leafList.c_str());
+      }
+    }
+
+    /******************************************************************************************************************/
+
+    /**
+     * Thread flushing the baskets of the trees and saving the tree headers in the background, so this is not done on
+     * the thread filling the trees. The trees are protected by treeMutex, hence filling the next entry only waits if a
+     * flush is still running. The duration of the last flush is measured.
+     */
+    class ROOTFlusher {
+     public:
+      ROOTFlusher() : _thread([this] { run(); }) {}
+
+      ~ROOTFlusher() {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _stop = true;
+        }
+        _wakeUp.notify_one();
+        _thread.join();
       }
-      ~ROOTstorage() { close(); }
 
-      void close() {
+      /** Request a flush of the given trees, also saving the tree headers if saveHeader is true. */
+      void request(const std::vector<TTree*>& trees, bool saveHeader) {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _trees.assign(trees.begin(), trees.end());
+          _requested = true;
+          _saveHeader = _saveHeader || saveHeader;
+        }
+        _wakeUp.notify_one();
+      }
+
+      /** Wait until the requested flush is done. Must be called before the trees are written or deleted. */
+      void wait() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [&] { return !_requested && !_busy; });
+      }
+
+      /** Protects the trees against concurrent access by the flusher and the thread filling the trees */
+      std::mutex treeMutex;
+
+      /** Duration of the last flush in milliseconds */
+      std::atomic<float> latency{0};
+      std::atomic<bool> latencyChanged{false};
+
+     private:
+      void run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while(true) {
+          _wakeUp.wait(lock, [&] { return _stop || _requested; });
+          if(!_requested) break;
+          _flushing.swap(_trees);
+          bool saveHeader = _saveHeader;
+          _requested = false;
+          _saveHeader = false;
+          _busy = true;
+          lock.unlock();
+
+          auto start = std::chrono::steady_clock::now();
+          {
+            std::lock_guard<std::mutex> treeLock(treeMutex);
+            for(auto* tree : _flushing) {
+              if(saveHeader) {
+                tree->AutoSave("SaveSelf");
+              }
+              else {
+                tree->FlushBaskets();
+              }
+            }
+          }
+          latency = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+          latencyChanged = true;
+
+          lock.lock();
+          _busy = false;
+          _done.notify_all();
+        }
+      }
+
+      // protected by _mutex
+      std::vector<TTree*> _trees; ///< Trees to be flushed with the pending request
+      bool _requested{false};
+      bool _saveHeader{false};
+      bool _busy{false};
+      bool _stop{false};
+      std::mutex _mutex;
+      std::condition_variable _wakeUp, _done;
+
+      std::vector<TTree*> _flushing; ///< Trees of the running flush, only accessed by the flusher thread
+
+      std::thread _thread; ///< must be last, so all other members are initialised when the thread starts
+    };
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    struct ROOTstorage : DAQStorage<TRIGGERTYPE> {
+      ROOTstorage(RootDAQ<TRIGGERTYPE>* owner) : outFile(nullptr), tree(nullptr), _owner(owner) {}
+      ~ROOTstorage() override { close(); }
+
+      void close() override {
+        flusher.wait();
         if(tree && outFile) {
           if(!tree->Write()) {
             std::cerr << "No data written to file, when writing the TTree." << std::endl;
           }
+          for(auto& group : rateGroupTrees) {
+            if(group.tree) group.tree->Write();
+          }
+        }
+        if(outFile) {
           outFile->Close();
+          delete outFile;
           outFile = nullptr;
           tree = nullptr;
+          for(auto& group : rateGroupTrees) group.tree = nullptr;
+          flushTrees.clear();
         }
       }
 
+      std::shared_ptr<FileSettings> getFileSettings() override;
+      bool open(const std::string& fileName, const FileSettings* settings) override;
+      bool write(const DAQSnapshot<TRIGGERTYPE>& snapshot) override;
+      void updateStatus() override;
+
+      /** Enable ROOT's implicit multithreading with the given number of threads, or disable it if 0 */
+      void setImplicitMT(uint32_t nThreads);
+
       TFile* outFile;
       TTree* tree;
       std::string currentGroupName;
 
-      /** Unique list of groups, used to create the groups in the file */
-      std::list<std::string> groupList;
-
-      /** boost::fusion::map of UserTypes to std::lists containing decimation
-       * factors. */
+      /**
+       * Entry of the write plan: the decimation of a single variable and its branch, compiled when the DAQ is started.
+       * The branch reads the values directly from the snapshot buffer or the decimator. Only values which are not
+       * contiguous in memory (decimation by picking every n-th value) and strings are copied to the staging buffer.
+       */
       template<typename UserType>
-      using decimationFactorList = std::list<size_t>;
-      TemplateUserTypeMapNoVoid<decimationFactorList> decimationFactorListMap;
+      struct Column {
+        Column(const DecimationSettings& settings, size_t nInputElements, const std::string& name)
+        : decimator(settings, nInputElements), branchName(name), isArray(nInputElements > 1),
+          staging(std::max<size_t>(decimator.nDecimated, 1)) {
+          assert(decimator.nDecimated > 0); // ensured by BaseDAQ::resolveDecimation()
+        }
+
+        Decimator<UserType> decimator;
+        std::string branchName;
+        bool isArray;
+        std::vector<UserType> staging;
+        TBranch* branch{nullptr}; ///< Branch in the current tree
+        bool inRecord{false};     ///< Scalar is a leaf of the compound record (see Record)
+        size_t recordOffset{0};   ///< Offset of the scalar in the compound record
+        bool recorded{true};      ///< Variable is recorded in the current file (see FileSettings::recorded)
+        size_t rateGroup{0};      ///< Rate group of the variable, 0 if recorded on each trigger
+
+        /** Uncompressed size of a single entry, the size of strings is unknown so short strings are assumed */
+        size_t bytesPerEntry() const {
+          return staging.size() * (std::is_same<UserType, std::string>::value ? 16 : sizeof(UserType));
+        }
+      };
 
+      /** boost::fusion::map of UserTypes to vectors containing the write plan, in the same order as the buffers of the
+       * snapshot. */
       template<typename UserType>
-      using fieldData = TreeDataFields<UserType>;
-      TemplateUserTypeMapNoVoid<fieldData> treeDataMap;
+      using columnList = std::vector<Column<UserType>>;
+      TemplateUserTypeMapNoVoid<columnList> columnListMap;
+
+      /** Scalars are packed into one compound record per entry, taken from RootDAQ::compoundScalars when opening */
+      bool compoundScalars{false};
+
+      /**
+       * Compound record containing all recorded scalars except strings, stored in the single branch MicroDAQ.scalars
+       * instead of one branch per scalar. The layout is computed when the DAQ is started and again when the recorded
+       * variables change.
+       */
+      struct Record {
+        std::string leafList;   ///< Leaf list of the branch, leaves ordered by decreasing size
+        std::vector<char> data; ///< Packed record of the current entry, read by the branch
+        TBranch* branch{nullptr};
+      } record;
+
+      /**
+       * Assign the offsets of all recorded scalars in the compound record and build its leaf list. Leaves are ordered by
+       * decreasing size, so each leaf is naturally aligned in the packed record as assumed by ROOT.
+       */
+      void createRecordLayout();
+
+      /**
+       * Tree of a rate group (see BaseDAQ::addRateGroup()), named <treeName>_<group name>. It contains the branches of
+       * the variables of the group, the trigger number and the time stamp, and is only filled on the triggers the group
+       * is due. The trees are created and written together with the tree of the variables recorded on each trigger.
+       */
+      struct RateGroupTree {
+        TTree* tree{nullptr};
+        ULong64_t triggerNumber{0};
+        Long64_t timeStampNs{0};
+      };
+
+      /** Trees of the rate groups in the order of the groups, allocated once so the branch addresses stay valid */
+      std::vector<RateGroupTree> rateGroupTrees;
+
+      /** Whether the variables of the rate group are written with the given trigger, see BaseDAQ::addRateGroup() */
+      bool isDue(size_t rateGroup, uint64_t triggerNumber) const {
+        return _owner->isRateGroupDue(rateGroup, triggerNumber);
+      }
 
       TTimeStamp timeStamp;
 
-      TreeDataFields<TRIGGERTYPE> missedTrigger{};
+      /** Time of the trigger in nanoseconds since epoch */
+      Long64_t timeStampNs{};
+
+      std::vector<TRIGGERTYPE> nMissedTriggers{TRIGGERTYPE()};
       Long64_t triggerPeriod{};
 
-      bool firstTrigger{true};
+      /** Number of entries after which the tree is saved, taken from RootDAQ::flushAfterNEntries when opening */
+      uint32_t flushAfterNEntries{0};
 
-      void processTrigger();
+      /** Minimum time between saving the tree header, taken from RootDAQ::autoSavePeriod when opening */
+      std::chrono::seconds autoSavePeriod{0};
+      std::chrono::steady_clock::time_point lastAutoSave;
+
+      ROOTFlusher flusher;
+
+      /** Trees handed to the flusher: the tree of the variables recorded on each trigger and the rate group trees */
+      std::vector<TTree*> flushTrees;
+
+      /** Estimated uncompressed size of all branches of a single entry, see BaseDAQ::estimateBytesPerTrigger() */
+      uint64_t bytesPerEntry{0};
+
+      /** Number of entries per cluster derived from RootDAQ::clusterSize when opening, 0 to use the ROOT defaults */
+      Long64_t entriesPerCluster{0};
+
+      /** Number of threads of the implicit multithreading enabled by this storage */
+      uint32_t implicitMTThreads{0};
+
+      /** Limits of the basket size of the branches if derived from the cluster size */
+      static constexpr size_t minBasketSize{1024};
+      static constexpr size_t maxBasketSize{16 * 1024 * 1024};
 
       RootDAQ<TRIGGERTYPE>* _owner;
 
@@ -88,26 +327,24 @@ namespace ChimeraTK {
 
         // get the lists for the UserType
         auto& accessorList = pair.second;
-        auto& decimationFactorList = boost::fusion::at_key<UserType>(_storage.decimationFactorListMap.table);
-        auto& treeData = boost::fusion::at_key<UserType>(_storage.treeDataMap.table);
+        auto& columnList = boost::fusion::at_key<UserType>(_storage.columnListMap.table);
         auto& nameList = boost::fusion::at_key<UserType>(_storage._owner->_nameListMap.table);
+        auto& decimationList = boost::fusion::at_key<UserType>(_storage._owner->_decimationListMap.table);
         auto& branchList = boost::fusion::at_key<UserType>(_storage._owner->_branchNameList.table);
+        auto& rateGroupList = boost::fusion::at_key<UserType>(_storage._owner->_rateGroupListMap.table);
 
         // iterate through all accessors for this UserType
+        columnList.reserve(accessorList.size());
         auto name = nameList.begin();
-        for(auto accessor = accessorList.begin(); accessor != accessorList.end(); ++accessor, ++name) {
+        auto decimation = decimationList.begin();
+        auto rateGroup = rateGroupList.begin();
+        for(auto accessor = accessorList.begin(); accessor != accessorList.end();
+            ++accessor, ++name, ++decimation, ++rateGroup) {
           // check if accessor uses DAQ trigger as external trigger
           if(_storage._owner->isAccessorUsingDAQTrigger(*accessor)) {
             _storage._accessorsWithTrigger.push_back(accessor->getId());
           }
 
-          // determine decimation factor
-          int factor = 1;
-          if(accessor->getNElements() > _storage._owner->_decimationThreshold) {
-            factor = _storage._owner->_decimationFactor;
-          }
-          decimationFactorList.push_back(factor);
-
           /* Format the names -> replace '/' with '.'
            * This format is used for ROOT branch names
            */
@@ -117,24 +354,10 @@ namespace ChimeraTK {
           if(nameWithDot.at(0) != '.') throw ChimeraTK::logic_error("Unexpected register name.");
           nameWithDot = nameWithDot.substr(1, nameWithDot.length());
           branchList.push_back(nameWithDot);
-          // Add map entry -> based on the length create a scalar or an array
-          if(accessor->getNElements() > 1) {
-            // create map entry (empty array)
-            auto array = treeData.trace[nameWithDot];
-            // set array length
-            array.Set(accessor->getNElements() / factor);
-            // assign array with correct length to the map entry
-            treeData.trace[nameWithDot] = array;
-          }
-          else {
-            treeData.parameter[nameWithDot];
-          }
-          // put all group names in list (each hierarchy level separately)
-          size_t idx = 0;
-          while((idx = name->find('/', idx + 1)) != std::string::npos) {
-            std::string groupName = name->substr(0, idx);
-            _storage.groupList.push_back(groupName);
-          }
+
+          // determine decimation, based on the length a scalar or an array branch is created
+          auto& column = columnList.emplace_back(*decimation, accessor->getNElements(), nameWithDot);
+          column.rateGroup = *rateGroup;
         }
       }
 
@@ -148,23 +371,26 @@ namespace ChimeraTK {
       ROOTTreeCreator(ROOTstorage<TRIGGERTYPE>& storage, const std::string& name) : _storage(storage), _name(name) {}
 
       template<typename PAIR>
-      void operator()(PAIR&) const {
-        typedef typename PAIR::first_type UserType;
-
+      void operator()(PAIR& pair) const {
         if(!_storage.tree) _storage.tree = new TTree(_name.c_str(), "Data produced by ChimeraTK RootDAQ module");
-        // get the lists for the UserType
-        auto& treeData = boost::fusion::at_key<UserType>(_storage.treeDataMap.table);
 
-        for(auto& accessor : treeData.parameter) {
-          // determine decimation factor
-          if(_storage.tree->Branch(accessor.first.c_str(), &accessor.second) == nullptr) {
-            throw ChimeraTK::logic_error((std::string("Failed to add branch for variable ") + accessor.first).c_str());
+        for(auto& column : pair.second) {
+          // scalars packed into the compound record and variables not recorded have no branch of their own
+          if(!column.recorded || (_storage.compoundScalars && column.inRecord)) {
+            column.branch = nullptr;
+            continue;
           }
-        }
-        for(auto& accessor : treeData.trace) {
-          // determine decimation factor
-          if(_storage.tree->Branch(accessor.first.c_str(), &accessor.second) == nullptr) {
-            throw ChimeraTK::logic_error((std::string("Failed to add branch for variable ") + accessor.first).c_str());
+          // variables of rate groups are stored in the tree of their group
+          auto* tree = column.rateGroup == 0 ? _storage.tree : _storage.rateGroupTrees[column.rateGroup - 1].tree;
+          column.branch = createBranch(tree, column.branchName, column.staging, column.isArray);
+          if(column.branch == nullptr) {
+            throw ChimeraTK::logic_error("Failed to add branch for variable " + column.branchName);
+          }
+          // a single basket per cluster, the trees of the rate groups use the ROOT defaults
+          if(_storage.entriesPerCluster > 0 && column.rateGroup == 0) {
+            auto basketSize = std::clamp<size_t>(column.bytesPerEntry() * _storage.entriesPerCluster,
+                ROOTstorage<TRIGGERTYPE>::minBasketSize, ROOTstorage<TRIGGERTYPE>::maxBasketSize);
+            column.branch->SetBasketSize(static_cast<Int_t>(basketSize));
           }
         }
       }
@@ -177,108 +403,194 @@ namespace ChimeraTK {
 
     template<typename TRIGGERTYPE>
     struct ROOTDataWriter {
-      ROOTDataWriter(ROOTstorage<TRIGGERTYPE>& storage) : _storage(storage) {}
+      ROOTDataWriter(ROOTstorage<TRIGGERTYPE>& storage, const DAQSnapshot<TRIGGERTYPE>& snapshot)
+      : _storage(storage), _snapshot(snapshot) {}
 
       template<typename PAIR>
-      void operator()(PAIR&) const {
+      void operator()(PAIR& pair) const {
         typedef typename PAIR::first_type UserType;
 
-        // get the lists for the UserType
-        auto& decimationFactorList = boost::fusion::at_key<UserType>(_storage.decimationFactorListMap.table);
-        auto& accessorList = boost::fusion::at_key<UserType>(_storage._owner->_accessorListMap.table);
-        auto& branchList = boost::fusion::at_key<UserType>(_storage._owner->_branchNameList.table);
-        auto& treeDataMap = boost::fusion::at_key<UserType>(_storage.treeDataMap.table);
-
-        auto branchName = branchList.begin();
-        auto decimationFactor = decimationFactorList.begin();
-
-        for(auto accessor = accessorList.begin(); accessor != accessorList.end();
-            ++accessor, ++branchName, ++decimationFactor) {
-          if(accessor->getNElements() > 1) {
-            size_t n = accessor->getNElements() / (*decimationFactor);
-            for(size_t i = 0; i < n; i++) treeDataMap.trace[*branchName][i] = (*accessor)[i * (*decimationFactor)];
+        // iterate through the write plan for this UserType
+        auto& bufferList = pair.second;
+        auto& columnList = boost::fusion::at_key<UserType>(_storage.columnListMap.table);
+        for(size_t i = 0; i < columnList.size(); ++i) {
+          auto& column = columnList[i];
+          if(!column.recorded || !_storage.isDue(column.rateGroup, _snapshot.triggerNumber)) continue;
+          auto decimated = column.decimator(bufferList[i]);
+          if(_storage.compoundScalars && column.inRecord) {
+            std::memcpy(_storage.record.data.data() + column.recordOffset, decimated.data, sizeof(UserType));
+          }
+          else if(std::is_same<UserType, std::string>::value || decimated.stride != 1) {
+            for(size_t k = 0; k < column.decimator.nDecimated; k++) {
+              column.staging[k] = decimated.data[k * decimated.stride];
+            }
           }
           else {
-            treeDataMap.parameter[*branchName] = (*accessor)[0];
+            // the snapshot buffers are reused, so the branch is pointed at the current buffer for each trigger
+            column.branch->SetAddress(const_cast<UserType*>(decimated.data));
           }
         }
       }
 
       ROOTstorage<TRIGGERTYPE>& _storage;
+      const DAQSnapshot<TRIGGERTYPE>& _snapshot;
     };
 
     /******************************************************************************************************************/
 
     template<typename TRIGGERTYPE>
-    void ROOTstorage<TRIGGERTYPE>::processTrigger() {
-      // update daqPath if DAQ is disabled
-      _owner->updateDAQPath();
-
-      // need to open or close file?
-      if(!outFile && _owner->enable != 0 && _owner->status.errorStatus == 0) {
-        // some things to be done only on first trigger
-        if(firstTrigger) {
-          _owner->checkBufferOnFirstTrigger();
-          firstTrigger = false;
-        }
+    std::shared_ptr<FileSettings> ROOTstorage<TRIGGERTYPE>::getFileSettings() {
+      auto settings = std::make_shared<ROOTFileSettings>();
+      settings->flushAfterNEntries = _owner->flushAfterNEntries;
+      settings->autoSavePeriod = _owner->autoSavePeriod;
+      settings->compressionAlgorithm = (std::string)_owner->compressionAlgorithm;
+      settings->compressionLevel = _owner->compressionLevel;
+      settings->compressionThreads = _owner->compressionThreads;
+      settings->clusterSize = _owner->clusterSize;
+      settings->compoundScalars = (_owner->compoundScalars != 0);
+      return settings;
+    }
 
-        std::string filename = _owner->nextBuffer();
-        // open file
-        outFile = TFile::Open((_owner->_daqPath / filename).c_str(), "RECREATE");
-        if(outFile) {
-          outFile->SetCompressionAlgorithm(ROOT::RCompressionSetting::EAlgorithm::kZSTD);
-          outFile->SetCompressionLevel(ROOT::RCompressionSetting::ELevel::kDefaultZSTD);
-        }
-      }
-      // close file and update error status for inactive DAQ
-      else if(outFile && _owner->enable == 0) {
-        close();
-        _owner->disableDAQ();
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    bool ROOTstorage<TRIGGERTYPE>::open(const std::string& fileName, const FileSettings* settings) {
+      auto& rootSettings = *static_cast<const ROOTFileSettings*>(settings);
+      setImplicitMT(rootSettings.compressionThreads);
+      outFile = TFile::Open(fileName.c_str(), "RECREATE");
+      if(!outFile) return false;
+      outFile->SetCompressionSettings(
+          rootCompressionSettings(rootSettings.compressionAlgorithm, rootSettings.compressionLevel));
+      flushAfterNEntries = rootSettings.flushAfterNEntries;
+      autoSavePeriod = std::chrono::seconds(rootSettings.autoSavePeriod);
+      lastAutoSave = std::chrono::steady_clock::now();
+      // the leaves of the record depend on the recorded variables
+      if(applyRecordedMask(columnListMap, rootSettings)) createRecordLayout();
+      compoundScalars = rootSettings.compoundScalars && !record.data.empty();
+      entriesPerCluster = 0;
+      if(rootSettings.clusterSize > 0) {
+        uint64_t clusterBytes = static_cast<uint64_t>(rootSettings.clusterSize) * 1024;
+        entriesPerCluster =
+            static_cast<Long64_t>(std::max<uint64_t>(clusterBytes / std::max<uint64_t>(bytesPerEntry, 1), 1));
       }
+      return true;
+    }
 
-      if(outFile) {
-        if(!tree) {
-          boost::fusion::for_each(treeDataMap.table, ROOTTreeCreator<TRIGGERTYPE>(*this, _owner->_treeName));
-          tree->Branch("MicroDAQ.triggerPeriod", &triggerPeriod);
-          tree->Branch("MicroDAQ.nMissedTriggers", &missedTrigger.parameter["missedTrigger"]);
-          tree->Branch("timeStamp", &timeStamp);
-        }
-        // construct time stamp
-        timeStamp = TTimeStamp();
+    /******************************************************************************************************************/
 
-        // write data
-        boost::fusion::for_each(treeDataMap.table, ROOTDataWriter<TRIGGERTYPE>(*this));
-        missedTrigger.parameter["missedTrigger"] = _owner->BaseDAQ<TRIGGERTYPE>::status.nMissedTriggers;
-        triggerPeriod = _owner->BaseDAQ<TRIGGERTYPE>::status.triggerPeriod;
-        tree->Fill();
-        _owner->status.currentEntry = _owner->status.currentEntry + 1;
-        _owner->status.currentEntry.write();
+    template<typename TRIGGERTYPE>
+    void ROOTstorage<TRIGGERTYPE>::setImplicitMT(uint32_t nThreads) {
+      // implicit multithreading is process-wide, so it is only changed if it was set by this storage before
+      if(nThreads == implicitMTThreads) return;
+      if(implicitMTThreads > 0) ROOT::DisableImplicitMT();
+      if(nThreads > 0) {
+        std::cout << "RootDAQ: Enabling implicit multithreading with " << nThreads << " threads." << std::endl;
+        ROOT::EnableImplicitMT(nThreads);
       }
+      implicitMTThreads = nThreads;
+    }
 
-      // update error status for active DAQ
-      if(_owner->enable == 1) {
-        // only write error message once
-        if(!outFile && _owner->status.errorStatus == 0) {
-          std::cerr
-              << "Something went wrong. File could not be opened. Solve the problem and toggle enable DAQ to try again."
-              << std::endl;
-          _owner->status.errorStatus = 1;
-          _owner->status.errorStatus.write();
-          delete outFile;
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    bool ROOTstorage<TRIGGERTYPE>::write(const DAQSnapshot<TRIGGERTYPE>& snapshot) {
+      if(!tree) {
+        for(size_t i = 0; i < rateGroupTrees.size(); ++i) {
+          auto& group = rateGroupTrees[i];
+          auto name = _owner->_treeName + "_" + _owner->_rateGroups[i].name;
+          group.tree = new TTree(name.c_str(), "Rate group produced by ChimeraTK RootDAQ module");
+          group.tree->Branch("MicroDAQ.triggerNumber", &group.triggerNumber);
+          group.tree->Branch("timeStampNs", &group.timeStampNs);
         }
-        else if(outFile && _owner->status.errorStatus != 0) {
-          _owner->status.errorStatus = 0;
-          _owner->status.errorStatus.write();
+        boost::fusion::for_each(columnListMap.table, ROOTTreeCreator<TRIGGERTYPE>(*this, _owner->_treeName));
+        if(compoundScalars) {
+          record.branch = tree->Branch("MicroDAQ.scalars", record.data.data(), record.leafList.c_str());
+          if(entriesPerCluster > 0) {
+            record.branch->SetBasketSize(static_cast<Int_t>(
+                std::clamp<size_t>(record.data.size() * entriesPerCluster, minBasketSize, maxBasketSize)));
+          }
+        }
+        tree->Branch("MicroDAQ.triggerPeriod", &triggerPeriod);
+        createBranch(tree, "MicroDAQ.nMissedTriggers", nMissedTriggers, false);
+        tree->Branch("timeStamp", &timeStamp);
+        tree->Branch("timeStampNs", &timeStampNs);
+        if(entriesPerCluster > 0) tree->SetAutoFlush(entriesPerCluster);
+
+        flushTrees.assign(1, tree);
+        for(auto& group : rateGroupTrees) flushTrees.push_back(group.tree);
+      }
+      // time stamp of the trigger
+      timeStampNs =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.version.getTime().time_since_epoch()).count();
+      timeStamp =
+          TTimeStamp(static_cast<time_t>(timeStampNs / 1000000000), static_cast<Int_t>(timeStampNs % 1000000000));
+
+      // write data, waits if the flusher is still busy
+      Long64_t nEntries;
+      {
+        std::lock_guard<std::mutex> lock(flusher.treeMutex);
+        boost::fusion::for_each(snapshot.buffers.table, ROOTDataWriter<TRIGGERTYPE>(*this, snapshot));
+        nMissedTriggers[0] = snapshot.nMissedTriggers;
+        triggerPeriod = snapshot.triggerPeriod;
+        tree->Fill();
+        nEntries = tree->GetEntriesFast();
+        for(size_t i = 0; i < rateGroupTrees.size(); ++i) {
+          if(!isDue(i + 1, snapshot.triggerNumber)) continue;
+          auto& group = rateGroupTrees[i];
+          group.triggerNumber = snapshot.triggerNumber;
+          group.timeStampNs = timeStampNs;
+          group.tree->Fill();
         }
       }
-      // close file if all triggers are filled
-      if(outFile) {
-        auto nEntries = tree->GetEntriesFast();
-        if(_owner->flushAfterNEntries > 0 && nEntries % _owner->flushAfterNEntries == 1) tree->AutoSave("SaveSelf");
-        if(_owner->maxEntriesReached()) close();
+
+      // flush the baskets in the background, the tree header is saved at most once per autoSavePeriod
+      if(flushAfterNEntries > 0 && nEntries % flushAfterNEntries == 1) {
+        auto now = std::chrono::steady_clock::now();
+        bool saveHeader = now - lastAutoSave >= autoSavePeriod;
+        if(saveHeader) lastAutoSave = now;
+        flusher.request(flushTrees, saveHeader);
+      }
+      return true;
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void ROOTstorage<TRIGGERTYPE>::createRecordLayout() {
+      // strings are of variable length and stay separate branches
+      size_t size = 0;
+      record.leafList.clear();
+      for(size_t leafSize : {8, 4, 2, 1}) {
+        boost::fusion::for_each(columnListMap.table, [&](auto& pair) {
+          using UserType = typename std::decay_t<decltype(pair)>::first_type;
+          if constexpr(!std::is_same<UserType, std::string>::value) {
+            if(sizeof(UserType) != leafSize) return;
+            for(auto& column : pair.second) {
+              column.inRecord = column.recorded && !column.isArray && column.rateGroup == 0;
+              if(!column.inRecord) continue;
+              column.recordOffset = size;
+              size += sizeof(UserType);
+              if(!record.leafList.empty()) record.leafList += ":";
+              record.leafList += column.branchName + "/" + LeafType<UserType>::code;
+            }
+          }
+        });
+      }
+      record.data.assign(size, 0);
+    }
+
+    /******************************************************************************************************************/
+
+    template<typename TRIGGERTYPE>
+    void ROOTstorage<TRIGGERTYPE>::updateStatus() {
+      if(flusher.latencyChanged.exchange(false)) {
+        _owner->flushLatency = flusher.latency;
+        _owner->flushLatency.write();
       }
     }
 
+    /******************************************************************************************************************/
+
   } // namespace detail
 
   /********************************************************************************************************************/
@@ -286,6 +598,7 @@ namespace ChimeraTK {
   template<typename TRIGGERTYPE>
   void RootDAQ<TRIGGERTYPE>::mainLoop() {
     std::cout << "Initializing ROOTDAQ system..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
 
     // storage object
     detail::ROOTstorage<TRIGGERTYPE> storage(this);
@@ -297,21 +610,17 @@ namespace ChimeraTK {
     // add trigger
     storage._accessorsWithTrigger.push_back(BaseDAQ<TRIGGERTYPE>::trigger.getId());
 
-    // sort group list and make unique to make sure lower levels get created first
-    storage.groupList.sort();
-    storage.groupList.unique();
+    storage.bytesPerEntry = BaseDAQ<TRIGGERTYPE>::estimateBytesPerTrigger();
+    storage.rateGroupTrees.resize(BaseDAQ<TRIGGERTYPE>::_rateGroups.size());
 
-    // write initial values
-    storage.processTrigger();
+    // the record layout is the same for all files
+    storage.createRecordLayout();
 
-    // loop: process incoming triggers
-    auto group = ApplicationModule::readAnyGroup();
-    while(true) {
-      // Wait for the DAQ trigger and an update of all accessors using the DAQ trigger as external node
-      group.readUntilAll(storage._accessorsWithTrigger);
-      storage.processTrigger();
-      BaseDAQ<TRIGGERTYPE>::updateDiagnostics();
-    }
+    // the tree is flushed by a separate thread, files are written by a separate thread in asynchronous mode
+    ROOT::EnableThreadSafety();
+
+    BaseDAQ<TRIGGERTYPE>::_startupTimes.writePlan = std::chrono::steady_clock::now() - start;
+    BaseDAQ<TRIGGERTYPE>::runDAQ(storage, storage._accessorsWithTrigger);
   }
 
   /********************************************************************************************************************/
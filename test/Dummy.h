@@ -175,6 +175,31 @@ struct DummyArray<bool> : public ChimeraTK::ApplicationModule {
 
 /**********************************************************************************************************************/
 
+/**
+ * Module with a scalar that is only updated on triggers with even value.
+ */
+struct DummySlow : public ChimeraTK::ApplicationModule {
+  using ChimeraTK::ApplicationModule::ApplicationModule;
+  ChimeraTK::ScalarOutput<int> slow{this, "slow", "", "Updated on even triggers", {"DAQ"}};
+  ChimeraTK::ScalarOutput<int> outTrigger{this, "outTrigger", "", "DAQ trigger", {"DAQ"}};
+  ChimeraTK::ScalarPushInput<int> trigger{this, "trigger", "", "Trigger", {}};
+
+  void mainLoop() override {
+    writeAll();
+    while(true) {
+      trigger.read();
+      if(trigger % 2 == 0) {
+        slow = (int)trigger;
+        slow.write();
+      }
+      outTrigger = (int)trigger;
+      outTrigger.write();
+    }
+  }
+};
+
+/**********************************************************************************************************************/
+
 /**
  * Define a test app to test adding device modules to the MicroDAQ module
  */